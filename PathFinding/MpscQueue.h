@@ -0,0 +1,102 @@
+/****************************************************************************
+ Copyright (c) 2015 QuanNguyen
+ 
+ http://quannguyen.info
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+
+#ifndef __Funny_PathFinding__MpscQueue__
+#define __Funny_PathFinding__MpscQueue__
+
+#include <atomic>
+#include <utility>
+
+namespace pathfinding {
+    
+    /**
+     *  Lock free queue, many threads push, one thread pop (Vyukov's node based MPSC queue).
+     *  A push is one exchange and one store, a pop never wait: while a push is half done
+     *  the queue look empty for a moment.
+     */
+    template <typename T>
+    class MpscQueue {
+        
+    public:
+        MpscQueue()
+        {
+            Node* stub = new Node();
+            _head.store(stub, std::memory_order_relaxed);
+            _tail = stub;
+        }
+        
+        ~MpscQueue()
+        {
+            T value;
+            while (pop(value)) {
+            }
+            delete _tail;
+        }
+        
+        /**
+         *  thread safe
+         */
+        void push(T value)
+        {
+            Node* node = new Node();
+            node->value = std::move(value);
+            Node* prev = _head.exchange(node, std::memory_order_acq_rel);
+            prev->next.store(node, std::memory_order_release);
+        }
+        
+        /**
+         *  only from the consumer thread
+         *  @return false if empty
+         */
+        bool pop(T& value)
+        {
+            Node* tail = _tail;
+            Node* next = tail->next.load(std::memory_order_acquire);
+            if(next == nullptr){
+                return false;
+            }
+            
+            // next become the stub
+            value = std::move(next->value);
+            _tail = next;
+            delete tail;
+            return true;
+        }
+        
+    protected:
+        struct Node {
+            Node() : next(nullptr) {}
+            std::atomic<Node*> next;
+            T value;
+        };
+        
+        std::atomic<Node*> _head;
+        Node* _tail;
+        
+        MpscQueue(const MpscQueue&);
+        MpscQueue& operator=(const MpscQueue&);
+    };
+}
+
+#endif /* defined(__Funny_PathFinding__MpscQueue__) */
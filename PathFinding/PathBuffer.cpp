@@ -0,0 +1,168 @@
+/****************************************************************************
+ Copyright (c) 2015 QuanNguyen
+ 
+ http://quannguyen.info
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+
+#include "PathBuffer.h"
+
+USING_NS_CC;
+
+namespace pathfinding {
+    
+    const int PathBuffer::kDirectionX[8] = {0, 0, -1, 1, 1, 1, -1, -1};
+    const int PathBuffer::kDirectionY[8] = {-1, 1, 0, 0, -1, 1, -1, 1};
+    
+    static const int kMaxRunLength = 0x2000;
+    
+    // (dx + 1) * 3 + (dy + 1) -> direction
+    static const int kDirectionIndex[9] = {6, 2, 7, 0, -1, 1, 4, 3, 5};
+    
+    PathBuffer::const_iterator& PathBuffer::const_iterator::operator++()
+    {
+        if(_run == 0){
+            _run = 1;
+            _step = 1;
+        }else if(_step < getRunLength(_buffer->_runs[_run - 1])){
+            _step ++;
+        }else{
+            _run ++;
+            _step = 1;
+        }
+        
+        if(_run <= _buffer->_runs.size()){
+            int direction = getRunDirection(_buffer->_runs[_run - 1]);
+            _x += kDirectionX[direction];
+            _y += kDirectionY[direction];
+        }
+        return *this;
+    }
+    
+    void PathBuffer::clear()
+    {
+        _runs.clear();
+        _length = 0;
+        _reversing = false;
+    }
+    
+    void PathBuffer::reserve(size_t runCount)
+    {
+        _runs.reserve(runCount);
+    }
+    
+    void PathBuffer::appendStep(int direction)
+    {
+        CCASSERT(direction >= 0, "Tiles of a path must be neighbours");
+        
+        if(!_runs.empty() && getRunDirection(_runs.back()) == direction
+           && getRunLength(_runs.back()) < kMaxRunLength){
+            _runs.back() ++;
+        }else{
+            _runs.push_back(direction << 13);
+        }
+    }
+    
+    void PathBuffer::push(int x, int y)
+    {
+        CCASSERT(!_reversing, "Finish the reverse build first");
+        
+        if(_length == 0){
+            _startX = x;
+            _startY = y;
+        }else{
+            appendStep(kDirectionIndex[(x - _endX + 1) * 3 + (y - _endY + 1)]);
+        }
+        _endX = x;
+        _endY = y;
+        _length ++;
+    }
+    
+    void PathBuffer::assign(int startX, int startY, const uint16_t* runs, size_t runCount)
+    {
+        clear();
+        _runs.assign(runs, runs + runCount);
+        _startX = startX;
+        _startY = startY;
+        _endX = startX;
+        _endY = startY;
+        _length = 1;
+        for (auto run : _runs) {
+            int direction = getRunDirection(run);
+            int length = getRunLength(run);
+            _endX += kDirectionX[direction] * length;
+            _endY += kDirectionY[direction] * length;
+            _length += length;
+        }
+    }
+    
+    void PathBuffer::beginReverse()
+    {
+        clear();
+        _reversing = true;
+    }
+    
+    void PathBuffer::pushReverse(int x, int y)
+    {
+        CCASSERT(_reversing, "Call beginReverse first");
+        
+        if(_length == 0){
+            _endX = x;
+            _endY = y;
+        }else{
+            // the step go forward from the new tile to the previous first tile
+            appendStep(kDirectionIndex[(_startX - x + 1) * 3 + (_startY - y + 1)]);
+        }
+        _startX = x;
+        _startY = y;
+        _length ++;
+    }
+    
+    void PathBuffer::endReverse()
+    {
+        std::reverse(_runs.begin(), _runs.end());
+        _reversing = false;
+    }
+    
+    PathBuffer::const_iterator PathBuffer::begin() const
+    {
+        return _length == 0 ? end() : const_iterator(this, 0, 0);
+    }
+    
+    PathBuffer::const_iterator PathBuffer::end() const
+    {
+        return const_iterator(this, _runs.size() + 1, 1);
+    }
+    
+    Vec2 PathBuffer::back() const
+    {
+        return Vec2(_endX, _endY);
+    }
+    
+    std::vector<Vec2> PathBuffer::toVector() const
+    {
+        std::vector<Vec2> result;
+        result.reserve(_length);
+        for (auto ite = begin(); ite != end(); ++ ite) {
+            result.push_back(*ite);
+        }
+        return result;
+    }
+}
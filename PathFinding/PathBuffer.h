@@ -0,0 +1,197 @@
+/****************************************************************************
+ Copyright (c) 2015 QuanNguyen
+ 
+ http://quannguyen.info
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+
+#ifndef __Funny_PathFinding__PathBuffer__
+#define __Funny_PathFinding__PathBuffer__
+
+#include "cocos2d.h"
+
+namespace pathfinding {
+    
+    /**
+     *  Compact path: start tile + runs of (direction, length), 2 bytes per straight run
+     *  instead of 8 bytes per tile for std::vector<cocos2d::Vec2>.
+     *
+     *  The buffer is meant to be owned by the caller and reused between queries,
+     *  clear() keep the capacity so a warm buffer never allocate.
+     *  Waypoints are expanded lazily with the iterator.
+     */
+    class PathBuffer
+    {
+    public:
+        /**
+         *  8 directions, same order as the moves of dijkstra::PathFinding::getNearbyTileCoord
+         */
+        static const int kDirectionX[8];
+        static const int kDirectionY[8];
+        
+        class const_iterator
+        {
+        public:
+            const_iterator(const PathBuffer* buffer, size_t run, int step) :
+            _buffer(buffer),
+            _run(run),
+            _step(step),
+            _x(buffer->_startX),
+            _y(buffer->_startY)
+            {
+            }
+            
+            inline cocos2d::Vec2 operator*() const {
+                return cocos2d::Vec2(_x, _y);
+            }
+            
+            inline int getX() const {
+                return _x;
+            }
+            
+            inline int getY() const {
+                return _y;
+            }
+            
+            const_iterator& operator++();
+            
+            inline bool operator==(const const_iterator& other) const {
+                return _run == other._run && _step == other._step;
+            }
+            
+            inline bool operator!=(const const_iterator& other) const {
+                return !(*this == other);
+            }
+            
+        protected:
+            const PathBuffer* _buffer;
+            size_t _run;        // the start tile is run 0, then 1 + run index
+            int _step;
+            int _x;
+            int _y;
+        };
+        
+        PathBuffer() :
+        _startX(0),
+        _startY(0),
+        _endX(0),
+        _endY(0),
+        _length(0),
+        _reversing(false)
+        {
+        };
+        
+        /**
+         *  empty the path, keep the memory
+         */
+        void clear();
+        
+        void reserve(size_t runCount);
+        
+        /**
+         *  build from the goal back to the start, as the engines walk their parent links
+         *  O(1) per tile, the runs are reversed once at the end
+         */
+        void beginReverse();
+        void pushReverse(int x, int y);
+        void endReverse();
+        
+        /**
+         *  append a tile after the last one, must be one of the 8 neighbours
+         */
+        void push(int x, int y);
+        
+        /**
+         *  replace the path by raw runs, as returned by getRuns, e.g. received from another process
+         */
+        void assign(int startX, int startY, const uint16_t* runs, size_t runCount);
+        
+        inline bool empty() const {
+            return _length == 0;
+        }
+        
+        /**
+         *  @return number of tiles
+         */
+        inline size_t size() const {
+            return _length;
+        }
+        
+        inline size_t getRunCount() const {
+            return _runs.size();
+        }
+        
+        /**
+         *  raw runs, (direction << 13) | (length - 1), to copy the path without expanding it
+         */
+        inline const uint16_t* getRuns() const {
+            return _runs.data();
+        }
+        
+        inline int getStartX() const {
+            return _startX;
+        }
+        
+        inline int getStartY() const {
+            return _startY;
+        }
+        
+        /**
+         *  @return bytes used by the path data
+         */
+        inline size_t getMemorySize() const {
+            return sizeof(*this) + _runs.capacity() * sizeof(uint16_t);
+        }
+        
+        const_iterator begin() const;
+        const_iterator end() const;
+        
+        cocos2d::Vec2 back() const;
+        
+        /**
+         *  expand to the same waypoints as the engines std::vector result
+         */
+        std::vector<cocos2d::Vec2> toVector() const;
+        
+    protected:
+        friend class const_iterator;
+        
+        // (direction << 13) | (length - 1)
+        std::vector<uint16_t> _runs;
+        int _startX;
+        int _startY;
+        int _endX;
+        int _endY;
+        size_t _length;
+        bool _reversing;
+        
+        void appendStep(int direction);
+        
+        inline static int getRunDirection(uint16_t run) {
+            return run >> 13;
+        }
+        
+        inline static int getRunLength(uint16_t run) {
+            return (run & 0x1FFF) + 1;
+        }
+    };
+}
+
+#endif /* defined(__Funny_PathFinding__PathBuffer__) */
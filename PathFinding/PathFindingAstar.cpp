@@ -32,7 +32,12 @@ namespace pathfinding{
     
     namespace Astar {
         
-        PathFinding::PathFinding()
+        PathFinding::PathFinding() :
+        _map(nullptr),
+        _agentSize(1),
+        _bidirectional(false),
+        _recorder(nullptr),
+        _landmarks(nullptr)
         {
             
         }
@@ -51,6 +56,18 @@ namespace pathfinding{
         {
             CCASSERT(map, "Map must be not null");
             _map = map;
+            _nearest.setupMap(map);
+            if(_recorder){
+                _recorder->registerMap(map);
+            }
+        }
+        
+        void PathFinding::setRecorder(trace::TraceRecorder *recorder)
+        {
+            _recorder = recorder;
+            if(_recorder && _map){
+                _recorder->registerMap(_map);
+            }
         }
         
         void PathFinding::insertToOpenStep(ShortestPathStep *step)
@@ -74,7 +91,24 @@ namespace pathfinding{
         {
             // Here we use the Manhattan method, which calculates the total number of step moved horizontally and vertically to reach the
             // final desired step from the current step, ignoring any obstacles that may be in the way
-            return std::abs(toCoord.x - fromCoord.x) + std::abs(toCoord.y - fromCoord.y);
+            int h = std::abs(toCoord.x - fromCoord.x) + std::abs(toCoord.y - fromCoord.y);
+            
+            // With landmarks the triangle inequality give a much better lower bound on maze maps,
+            // tables older than the map could overestimate so they are ignored until rebuilt
+            if(_landmarks && _landmarks->getMap() == _map && _landmarks->isUpToDate()){
+                h = std::max(h, _landmarks->computeLowerBound(fromCoord.x, fromCoord.y, toCoord.x, toCoord.y));
+            }
+            return h;
+        }
+        
+        int PathFinding::computeHScore(const cocos2d::Vec2 &fromCoord, const std::vector<cocos2d::Vec2> &goals)
+        {
+            // The nearest goal give the lower bound
+            int h = INT_MAX;
+            for (auto& goal : goals) {
+                h = std::min(h, computeHScore(fromCoord, goal));
+            }
+            return h;
         }
         
         int PathFinding::computeCostToMove(ShortestPathStep *from, ShortestPathStep *to)
@@ -87,6 +121,24 @@ namespace pathfinding{
         std::vector<Vec2> PathFinding::getNearbyTileCoord(const cocos2d::Vec2 &tileCoord)
         {
             std::vector<Vec2> result;
+            
+            // a tile agent only need the 3x3 free bits of the map less the ones blocked by the overlays
+            if(_agentSize <= 1){
+                // top, bottom, left, right
+                static const int dx[] = {0, 0, -1, 1};
+                static const int dy[] = {-1, 1, 0, 0};
+                unsigned int mask = _map->getNeighbourMask(tileCoord.x, tileCoord.y);
+                if(!_overlays.empty()){
+                    mask &= ~CollisionOverlay::getNeighbourMask(_overlays, tileCoord.x, tileCoord.y);
+                }
+                for (int i = 0; i < 4; i ++) {
+                    if(CollisionData::isNeighbourFree(mask, dx[i], dy[i])){
+                        result.push_back(Vec2(tileCoord.x + dx[i], tileCoord.y + dy[i]));
+                    }
+                }
+                return result;
+            }
+            
             //top
             Vec2 top = Vec2(tileCoord.x, tileCoord.y - 1);
             if(isValidCoord(top) && canMoveAtCoord(top)){
@@ -114,77 +166,204 @@ namespace pathfinding{
             return result;
         }
         
+        void PathFinding::clearSteps()
+        {
+            for (int i = 0; i < _openStep.size(); i ++) {
+                delete _openStep.at(i);
+            }
+            for (int i = 0; i < _closedStep.size(); i ++) {
+                delete _closedStep.at(i);
+            }
+            _openStep.clear();
+            _closedStep.clear();
+        }
+        
         std::vector<Vec2> PathFinding::getShortestPath(const cocos2d::Vec2 &fromCoord,
                                                        const cocos2d::Vec2 &toCoord)
         {
-#if DEBUG_PRINT
-            CCLOG("*** PATH SEARCH BEGIN : A*");
-#endif
+            trace::TraceQuery query(_recorder, _map, trace::TRACE_ENGINE_ASTAR, _bidirectional, _agentSize, fromCoord, toCoord);
             std::vector<Vec2> result;
-            // Check that there is a path to compute ;-)
-            if(fromCoord.equals(toCoord)){
+            if(_bidirectional){
+                findPathBidirectional(fromCoord, toCoord, result);
+                query.finish(result);
                 return result;
             }
             
-            // Must check that the desired location is walkable
-            // In our case it's really easy, because only wall are unwalkable
-            if(!isValidCoord(toCoord) || !canMoveAtCoord(toCoord)){
-                return result;
+            ShortestPathStep *step = findPath(fromCoord, toCoord);
+            
+            // Walk the parents back to the start, then reverse once
+            for (; step != NULL; step = step->getParent()) {
+                result.push_back(step->getPosition());
             }
+            std::reverse(result.begin(), result.end());
             
-            bool pathFound = false;
-            for (int i = 0; i < _openStep.size(); i ++) {
-                delete _openStep.at(i);
+            clearSteps();
+            query.finish(result);
+            return result;
+        }
+        
+        bool PathFinding::getShortestPath(const cocos2d::Vec2 &fromCoord,
+                                          const cocos2d::Vec2 &toCoord,
+                                          PathBuffer &result)
+        {
+            trace::TraceQuery query(_recorder, _map, trace::TRACE_ENGINE_ASTAR, _bidirectional, _agentSize, fromCoord, toCoord);
+            if(_bidirectional){
+                std::vector<Vec2> path;
+                findPathBidirectional(fromCoord, toCoord, path);
+                result.clear();
+                for (auto& coord : path) {
+                    result.push(coord.x, coord.y);
+                }
+                query.finish(result);
+                return !result.empty();
             }
-            for (int i = 0; i < _closedStep.size(); i ++) {
-                delete _closedStep.at(i);
+            
+            result.beginReverse();
+            ShortestPathStep *step = findPath(fromCoord, toCoord);
+            
+            for (; step != NULL; step = step->getParent()) {
+                result.pushReverse(step->getPosition().x, step->getPosition().y);
             }
-            _openStep.clear();
-            _closedStep.clear();
+            result.endReverse();
+            
+            clearSteps();
+            query.finish(result);
+            return !result.empty();
+        }
+        
+        std::vector<Vec2> PathFinding::getShortestPathToNearest(const cocos2d::Vec2 &fromCoord,
+                                                                const cocos2d::Vec2 &toCoord,
+                                                                cocos2d::Vec2 *resolvedGoal)
+        {
+            Vec2 goal;
+            bool valid = _nearest.resolve(fromCoord, toCoord, _agentSize, goal);
+            if(resolvedGoal){
+                *resolvedGoal = goal;
+            }
+            if(!valid){
+                return std::vector<Vec2>();
+            }
+            return getShortestPath(fromCoord, goal);
+        }
+        
+        bool PathFinding::getShortestPathToNearest(const cocos2d::Vec2 &fromCoord,
+                                                   const cocos2d::Vec2 &toCoord,
+                                                   PathBuffer &result,
+                                                   cocos2d::Vec2 *resolvedGoal)
+        {
+            Vec2 goal;
+            bool valid = _nearest.resolve(fromCoord, toCoord, _agentSize, goal);
+            if(resolvedGoal){
+                *resolvedGoal = goal;
+            }
+            if(!valid){
+                result.clear();
+                return false;
+            }
+            return getShortestPath(fromCoord, goal, result);
+        }
+        
+        std::vector<Vec2> PathFinding::getShortestPathToAny(const cocos2d::Vec2 &fromCoord,
+                                                            const std::vector<cocos2d::Vec2> &targets,
+                                                            int *winner)
+        {
+            std::vector<Vec2> result;
+            int found = -1;
+            ShortestPathStep *step = findPath(fromCoord, targets, &found);
+            
+            for (; step != NULL; step = step->getParent()) {
+                result.push_back(step->getPosition());
+            }
+            std::reverse(result.begin(), result.end());
+            
+            clearSteps();
+            if(winner){
+                *winner = found;
+            }
+            return result;
+        }
+        
+        ShortestPathStep* PathFinding::findPath(const cocos2d::Vec2 &fromCoord,
+                                                const cocos2d::Vec2 &toCoord)
+        {
+            std::vector<Vec2> targets(1, toCoord);
+            return findPath(fromCoord, targets, nullptr);
+        }
+        
+        ShortestPathStep* PathFinding::findPath(const cocos2d::Vec2 &fromCoord,
+                                                const std::vector<cocos2d::Vec2> &targets,
+                                                int *winner)
+        {
+#if DEBUG_PRINT
+            CCLOG("*** PATH SEARCH BEGIN : A*");
+#endif
+            if(winner){
+                *winner = -1;
+            }
+            _stats = SearchStats();
+            
+            // Must check that the desired locations are walkable, the others are ignored
+            std::vector<Vec2> goals;
+            std::vector<int> goalIndexes;
+            for (size_t i = 0; i < targets.size(); i ++) {
+                const Vec2& toCoord = targets.at(i);
+                
+                // Check that there is a path to compute ;-)
+                if(fromCoord.equals(toCoord)){
+                    if(winner){
+                        *winner = (int)i;
+                    }
+                    return NULL;
+                }
+                if(isValidCoord(toCoord) && canMoveAtCoord(toCoord)){
+                    goals.push_back(toCoord);
+                    goalIndexes.push_back((int)i);
+                }
+            }
+            if(goals.empty()){
+                return NULL;
+            }
+            
+            clearSteps();
             
             // Start by adding the from position to the open list
             auto openStep = new ShortestPathStep(fromCoord);
             insertToOpenStep(openStep);
             
             do{
+                if(_cancelCheck && _cancelCheck()){
+                    _stats.cancelled = true;
+                    return NULL;
+                }
+                
                 // Get the lowest F cost step
                 // Because the list is ordered, the first step is always the one with the lowest F cost
                 ShortestPathStep *currentStep = _openStep.front();
                 
                 // Add the current step to the closed set
                 _closedStep.push_back(currentStep);
+                _stats.forwardExpansions ++;
                 
                 // Remove it from the open list
                 // Note that if we wanted to first removing from the open list, care should be taken to the memory
                 _openStep.erase(_openStep.begin());
                 
-                // If the currentStep is the desired tile coordinate, we are done!
-                if (currentStep->getPosition().equals(toCoord)){
-                    pathFound = true;
-                    ShortestPathStep *tmpStep = currentStep;
+                // If the currentStep is one of the desired tile coordinates, we are done!
+                // The heuristic is admissible for every goal so the first one reached is the nearest
+                int goal = getGoalIndex(goals, currentStep->getPosition());
+                if (goal >= 0){
+                    if(winner){
+                        *winner = goalIndexes.at(goal);
+                    }
 #if DEBUG_PRINT
                     CCLOG("*** PATH FOUND :");
-#endif
-                    do {
-#if DEBUG_PRINT
+                    for (ShortestPathStep *tmpStep = currentStep; tmpStep != NULL; tmpStep = tmpStep->getParent()) {
                         CCLOG("%.0f %.0f", tmpStep->getPosition().x, tmpStep->getPosition().y);
-#endif
-                        result.push_back(tmpStep->getPosition());
-                        tmpStep = tmpStep->getParent(); // Go backward
-                    } while (tmpStep != NULL); // Until there is not more parent
-#if DEBUG_PRINT
+                    }
                     CCLOG("*** PATH END");
 #endif
-                    std::reverse(result.begin(), result.end());
-                    for (int i = 0; i < _openStep.size(); i ++) {
-                        delete _openStep.at(i);
-                    }
-                    for (int i = 0; i < _closedStep.size(); i ++) {
-                        delete _closedStep.at(i);
-                    }
-                    _openStep.clear();
-                    _closedStep.clear();
-                    break;
+                    // The steps are released by the caller once the path is read
+                    return currentStep;
                 }
                 
                 // Get the adjacent tiles coord of the current step
@@ -213,13 +392,14 @@ namespace pathfinding{
                         step->setGScore(currentStep->getGScore() + moveCost);
                         
                         // Compute the H score which is the estimated movement cost to move from that step to the desired tile coordinate
-                        step->setHScore(computeHScore(step->getPosition(), toCoord));
+                        step->setHScore(computeHScore(step->getPosition(), goals));
                         
                         // Adding it with the function which is preserving the list ordered by F score
                         insertToOpenStep(step);
                     }
                     else { // Already in the open list
                         
+                        delete step;
                         step = *openIte; // To retrieve the old one (which has its scores already computed ;-)
                         
                         // Check to see if the G score for that step is lower if we use the current step to get there
@@ -227,6 +407,7 @@ namespace pathfinding{
                             
                             // The G score is equal to the parent G score + the cost to move from the parent to it
                             step->setGScore(currentStep->getGScore() + moveCost);
+                            step->setParent(currentStep);
                             
                             // Because the G Score has changed, the F score may have changed too
                             // So to keep the open list ordered we have to remove the step, and re-insert it with
@@ -244,7 +425,60 @@ namespace pathfinding{
             CCLOG("*** PATH SEARCH END :");
 #endif
             
-            return result;
+            return NULL;
+        }
+        
+        bool PathFinding::findPathBidirectional(const cocos2d::Vec2 &fromCoord,
+                                                const cocos2d::Vec2 &toCoord,
+                                                std::vector<cocos2d::Vec2> &path)
+        {
+#if DEBUG_PRINT
+            CCLOG("*** PATH SEARCH BEGIN : bidirectional A*");
+#endif
+            path.clear();
+            _stats = SearchStats();
+            
+            // Check that there is a path to compute ;-)
+            if(fromCoord.equals(toCoord)){
+                return false;
+            }
+            
+            if(!isValidCoord(fromCoord) || !canMoveAtCoord(fromCoord)){
+                return false;
+            }
+            
+            if(!isValidCoord(toCoord) || !canMoveAtCoord(toCoord)){
+                return false;
+            }
+            
+            // the moves of the engine seen by the generic search
+            struct Graph {
+                PathFinding* _engine;
+                
+                std::vector<Vec2> getNeighbours(const Vec2& tile){
+                    return _engine->getNearbyTileCoord(tile);
+                }
+                double getCost(const Vec2& from, const Vec2& to){
+                    return 1;
+                }
+                double getHeuristic(const Vec2& from, const Vec2& to){
+                    return _engine->computeHScore(from, to);
+                }
+                bool isCancelled(){
+                    return _engine->_cancelCheck && _engine->_cancelCheck();
+                }
+                bool hasHeuristic(){
+                    return true;
+                }
+            };
+            
+            Graph graph = {this};
+            bool found = pathfinding::findPathBidirectional(graph, _bidirectionalTables, _map->getWidth(), _map->getHeight(),
+                                                            fromCoord, toCoord, path, _stats);
+#if DEBUG_PRINT
+            CCLOG("*** PATH SEARCH END : %d forward, %d backward expansions", _stats.forwardExpansions, _stats.backwardExpansions);
+#endif
+            return found;
         }
     }
 }
@@ -27,6 +27,13 @@
 
 #include "cocos2d.h"
 #include "CollisionData.h"
+#include "ClearanceMap.h"
+#include "CollisionOverlay.h"
+#include "PathFindingLandmark.h"
+#include "PathBuffer.h"
+#include "PathFindingBidirectional.h"
+#include "PathFindingNearest.h"
+#include "PathTrace.h"
 
 namespace pathfinding {
    
@@ -71,16 +78,107 @@ namespace pathfinding {
             
             std::vector<cocos2d::Vec2> getShortestPath(const cocos2d::Vec2& fromCoord,
                                                        const cocos2d::Vec2& toCoord);
+            
+            /**
+             *  same search, the path is written into a reusable compact buffer
+             *  @return true if a path was found
+             */
+            bool getShortestPath(const cocos2d::Vec2& fromCoord,
+                                 const cocos2d::Vec2& toCoord,
+                                 PathBuffer& result);
+            
+            /**
+             *  same search, but when the goal is a wall or can't be reached the path go to the
+             *  walkable tile nearest to it which is in the region of the start
+             *  the regions come from the map only, the overlays are not used to pick the goal
+             *  @param resolvedGoal if not null receive the tile used as goal
+             */
+            std::vector<cocos2d::Vec2> getShortestPathToNearest(const cocos2d::Vec2& fromCoord,
+                                                                const cocos2d::Vec2& toCoord,
+                                                                cocos2d::Vec2* resolvedGoal = nullptr);
+            bool getShortestPathToNearest(const cocos2d::Vec2& fromCoord,
+                                          const cocos2d::Vec2& toCoord,
+                                          PathBuffer& result,
+                                          cocos2d::Vec2* resolvedGoal = nullptr);
+            
+            /**
+             *  one search to the nearest of several targets, the walls in targets are ignored
+             *  @param winner if not null receive the index in targets of the reached one, -1 if none
+             */
+            std::vector<cocos2d::Vec2> getShortestPathToAny(const cocos2d::Vec2& fromCoord,
+                                                            const std::vector<cocos2d::Vec2>& targets,
+                                                            int* winner = nullptr);
         protected:
             virtual bool init();
             
+            /**
+             *  run the search, the steps stay alive until clearSteps()
+             *  @return the goal step or NULL if no path
+             */
+            ShortestPathStep* findPath(const cocos2d::Vec2& fromCoord, const cocos2d::Vec2& toCoord);
+            ShortestPathStep* findPath(const cocos2d::Vec2& fromCoord, const std::vector<cocos2d::Vec2>& targets, int* winner);
+            void clearSteps();
+            
+            /**
+             *  run the bidirectional search
+             *  @return false if no path
+             */
+            bool findPathBidirectional(const cocos2d::Vec2& fromCoord, const cocos2d::Vec2& toCoord,
+                                       std::vector<cocos2d::Vec2>& path);
+            
             CC_SYNTHESIZE_READONLY(CollisionData *, _map, Map);
             
+            /**
+             *  size in tiles of the agent, it cover [x, x + size) * [y, y + size) of its tile
+             *  bigger than 1 need CollisionData::enableClearanceMap, without it no path is found
+             */
+            CC_SYNTHESIZE(int, _agentSize, AgentSize);
+            
+            /**
+             *  getShortestPath search from both ends at once, same result with less
+             *  expansions on long queries. false by default
+             */
+            CC_SYNTHESIZE(bool, _bidirectional, Bidirectional);
+            
+            /**
+             *  work done by the last getShortestPath
+             */
+            CC_SYNTHESIZE_READONLY_PASS_BY_REF(SearchStats, _stats, Stats);
+            
+            /**
+             *  if set, called before every expansion, the search stop without path when it return true
+             *  (used to abandon the search of a job from another thread)
+             */
+            CC_SYNTHESIZE_PASS_BY_REF(std::function<bool()>, _cancelCheck, CancelCheck);
+            
+            /**
+             *  tiles blocked by these overlays can't be used, the map itself is not changed
+             *  they must have the size of the map, empty by default
+             */
+            CC_SYNTHESIZE_PASS_BY_REF(std::vector<CollisionOverlay *>, _overlays, Overlays);
+            
+            /**
+             *  if set, getShortestPath is recorded to it with the edits of the map (not retained)
+             *  the map is registered to it here and by setupMap, so the edits before the first query are recorded
+             */
+            CC_SYNTHESIZE_READONLY(trace::TraceRecorder *, _recorder, Recorder);
+            void setRecorder(trace::TraceRecorder* recorder);
+            
+            NearestTileResolver _nearest;
+            BidirectionalTables _bidirectionalTables;
+            
+            /**
+             *  optional ALT heuristic, must be built from the same map
+             *  when null or not rebuilt since the map changed the Manhattan distance is used
+             */
+            CC_SYNTHESIZE(landmark::LandmarkHeuristic *, _landmarks, Landmarks);
+            
             CC_SYNTHESIZE_READONLY_PASS_BY_REF(std::vector<ShortestPathStep *>, _openStep, OpenStep);
             CC_SYNTHESIZE_READONLY_PASS_BY_REF(std::vector<ShortestPathStep *>, _closedStep, ClosedStep);
             
             void insertToOpenStep(ShortestPathStep *step);
             int computeHScore(const cocos2d::Vec2& fromCoord, const cocos2d::Vec2& toCoord);
+            int computeHScore(const cocos2d::Vec2& fromCoord, const std::vector<cocos2d::Vec2>& goals);
             int computeCostToMove(ShortestPathStep *fromStep, ShortestPathStep* toStep);
             std::vector<cocos2d::Vec2> getNearbyTileCoord(const cocos2d::Vec2& tileCoord);
             
@@ -98,12 +196,28 @@ namespace pathfinding {
                 return getIte(array, step) != array.end();
             }
             
+            inline int getGoalIndex(const std::vector<cocos2d::Vec2>& goals, const cocos2d::Vec2& pos){
+                for (size_t i = 0; i < goals.size(); i ++) {
+                    if(goals.at(i).equals(pos)){
+                        return (int)i;
+                    }
+                }
+                return -1;
+            }
+            
             inline bool isValidCoord(const cocos2d::Vec2& coord){
                 return (coord.x >= 0 && coord.x < _map->getWidth() &&
                         coord.y >= 0 && coord.y < _map->getHeight());
             }
             inline bool canMoveAtCoord(const cocos2d::Vec2& coord){
-                return !_map->haveCollisionAtCoord(coord.x, coord.y);
+                if(_agentSize > 1){
+                    // without the clearance map the fit of the agent is unknown, nothing is walkable
+                    const ClearanceMap* clearance = _map->getClearanceMap();
+                    return clearance && clearance->getClearance(coord.x, coord.y) >= _agentSize &&
+                    !CollisionOverlay::isRectBlocked(_overlays, coord.x, coord.y, _agentSize, _agentSize);
+                }
+                return !_map->haveCollisionAtCoord(coord.x, coord.y) &&
+                !CollisionOverlay::isBlocked(_overlays, coord.x, coord.y);
             }
         };
     }
@@ -0,0 +1,280 @@
+/****************************************************************************
+ Copyright (c) 2015 QuanNguyen
+ 
+ http://quannguyen.info
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+
+#ifndef __Funny_PathFinding__Bidirectional__
+#define __Funny_PathFinding__Bidirectional__
+
+#include "cocos2d.h"
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <functional>
+
+namespace pathfinding {
+    
+    /**
+     *  work done by the last search of an engine
+     */
+    struct SearchStats {
+        SearchStats() :
+        forwardExpansions(0),
+        backwardExpansions(0),
+        cancelled(false)
+        {
+        };
+        
+        /** tiles expanded from the start */
+        int forwardExpansions;
+        
+        /** tiles expanded from the goal, 0 for a one direction search */
+        int backwardExpansions;
+        
+        /** the search was stopped by its cancel check */
+        bool cancelled;
+        
+        inline int getExpansions() const {
+            return forwardExpansions + backwardExpansions;
+        }
+    };
+    
+    /**
+     *  Tables of findPathBidirectional, kept by an engine between its searches.
+     *  A search only touch the tiles it reach: an entry is valid only if its stamp is the
+     *  generation of the search, so nothing is cleared between two searches.
+     */
+    class BidirectionalTables {
+        
+    public:
+        typedef std::pair<double, int> OpenEntry;
+        
+        BidirectionalTables() :
+        _generation(0)
+        {
+        }
+        
+        /**
+         *  start a search on a map of count tiles, the tables are only allocated when the size change
+         */
+        void begin(size_t count)
+        {
+            if(_nodes[0].size() != count){
+                for (int side = 0; side < 2; side ++) {
+                    _nodes[side].assign(count, Node());
+                }
+                _generation = 0;
+            }
+            // a node seen by the search has the stamp _generation, a closed one _generation + 1
+            _generation += 2;
+            if(_generation == 0){
+                // wrapped, the old stamps could look valid
+                for (int side = 0; side < 2; side ++) {
+                    std::fill(_nodes[side].begin(), _nodes[side].end(), Node());
+                }
+                _generation = 2;
+            }
+            for (int side = 0; side < 2; side ++) {
+                _open[side].clear();
+            }
+        }
+        
+        inline double getDistance(int side, int idx) const {
+            const Node& node = _nodes[side][idx];
+            return node.stamp - _generation < 2 ? node.distance : std::numeric_limits<double>::infinity();
+        }
+        inline int getParent(int side, int idx) const {
+            const Node& node = _nodes[side][idx];
+            return node.stamp - _generation < 2 ? node.parent : -1;
+        }
+        inline bool isClosed(int side, int idx) const {
+            return _nodes[side][idx].stamp == _generation + 1;
+        }
+        
+        inline void setReached(int side, int idx, double distance, int parent){
+            Node& node = _nodes[side][idx];
+            node.distance = distance;
+            node.parent = parent;
+            node.stamp = _generation;
+        }
+        inline void setClosed(int side, int idx){
+            _nodes[side][idx].stamp = _generation + 1;
+        }
+        
+        /** open list of a side, a min heap */
+        inline void push(int side, double priority, int idx){
+            _open[side].push_back(OpenEntry(priority, idx));
+            std::push_heap(_open[side].begin(), _open[side].end(), std::greater<OpenEntry>());
+        }
+        inline void pop(int side){
+            std::pop_heap(_open[side].begin(), _open[side].end(), std::greater<OpenEntry>());
+            _open[side].pop_back();
+        }
+        inline const OpenEntry& top(int side) const {
+            return _open[side].front();
+        }
+        inline bool isEmpty(int side) const {
+            return _open[side].empty();
+        }
+        inline size_t getOpenSize(int side) const {
+            return _open[side].size();
+        }
+        
+    protected:
+        struct Node {
+            Node() :
+            distance(0),
+            parent(-1),
+            stamp(0)
+            {
+            }
+            
+            double distance;
+            int32_t parent;
+            uint32_t stamp;
+        };
+        
+        std::vector<Node> _nodes[2];
+        std::vector<OpenEntry> _open[2];
+        uint32_t _generation;
+    };
+    
+    /**
+     *  Search from both ends at once, the side with the smaller open list is expanded.
+     *  The moves must be symmetric (true for the engines: the tile tests don't depend on the direction).
+     *
+     *  Graph provide:
+     *      std::vector<cocos2d::Vec2> getNeighbours(const cocos2d::Vec2& tile)
+     *      double getCost(const cocos2d::Vec2& from, const cocos2d::Vec2& to)
+     *      double getHeuristic(const cocos2d::Vec2& from, const cocos2d::Vec2& to), consistent, 0 for dijkstra
+     *      bool hasHeuristic()
+     *      bool isCancelled(), checked before every expansion
+     *
+     *  mu is the best path seen where the frontiers touch. Without heuristic the search stop when
+     *  topForward + topBackward >= mu, with a consistent heuristic when one of the tops >= mu,
+     *  either way no shorter path can remain so the result is optimal.
+     *
+     *  @param tables reused by the next searches, keep one per engine
+     *  @param path receive the tiles from fromCoord to toCoord, empty if no path or an end is outside of the map
+     */
+    template <typename Graph>
+    bool findPathBidirectional(Graph& graph, BidirectionalTables& tables, int width, int height,
+                               const cocos2d::Vec2& fromCoord, const cocos2d::Vec2& toCoord,
+                               std::vector<cocos2d::Vec2>& path, SearchStats& stats)
+    {
+        path.clear();
+        stats = SearchStats();
+        
+        // both ends index the tables
+        if(fromCoord.x < 0 || fromCoord.y < 0 || fromCoord.x >= width || fromCoord.y >= height ||
+           toCoord.x < 0 || toCoord.y < 0 || toCoord.x >= width || toCoord.y >= height){
+            return false;
+        }
+        
+        const double kInfinity = std::numeric_limits<double>::infinity();
+        tables.begin((size_t)width * height);
+        cocos2d::Vec2 ends[2] = {fromCoord, toCoord};
+        
+        for (int side = 0; side < 2; side ++) {
+            int idx = ends[side].x + ends[side].y * width;
+            tables.setReached(side, idx, 0, -1);
+            tables.push(side, graph.getHeuristic(ends[side], ends[1 - side]), idx);
+        }
+        
+        double mu = kInfinity;
+        int meet = -1;
+        bool heuristic = graph.hasHeuristic();
+        
+        while (true) {
+            // drop the entries of the tiles already closed
+            for (int side = 0; side < 2; side ++) {
+                while (!tables.isEmpty(side) && tables.isClosed(side, tables.top(side).second)) {
+                    tables.pop(side);
+                }
+            }
+            if(tables.isEmpty(0) || tables.isEmpty(1)){
+                break;
+            }
+            
+            double topForward = tables.top(0).first;
+            double topBackward = tables.top(1).first;
+            if(heuristic ? std::max(topForward, topBackward) >= mu : topForward + topBackward >= mu){
+                break;
+            }
+            
+            if(graph.isCancelled()){
+                stats.cancelled = true;
+                return false;
+            }
+            
+            int side = tables.getOpenSize(0) <= tables.getOpenSize(1) ? 0 : 1;
+            int current = tables.top(side).second;
+            tables.pop(side);
+            tables.setClosed(side, current);
+            if(side == 0){
+                stats.forwardExpansions ++;
+            }
+            else{
+                stats.backwardExpansions ++;
+            }
+            
+            double currentDistance = tables.getDistance(side, current);
+            cocos2d::Vec2 currentCoord(current % width, current / width);
+            auto nearby = graph.getNeighbours(currentCoord);
+            for (auto& coord : nearby) {
+                int idx = coord.x + coord.y * width;
+                if(tables.isClosed(side, idx)){
+                    continue;
+                }
+                
+                double distance = currentDistance + graph.getCost(currentCoord, coord);
+                if(distance < tables.getDistance(side, idx)){
+                    tables.setReached(side, idx, distance, current);
+                    tables.push(side, distance + graph.getHeuristic(coord, ends[1 - side]), idx);
+                    
+                    // the frontiers touch
+                    double through = distance + tables.getDistance(1 - side, idx);
+                    if(through < mu){
+                        mu = through;
+                        meet = idx;
+                    }
+                }
+            }
+        }
+        
+        if(meet < 0){
+            return false;
+        }
+        
+        // start -> meet from the forward parents, then meet -> goal from the backward ones
+        for (int idx = meet; idx >= 0; idx = tables.getParent(0, idx)) {
+            path.push_back(cocos2d::Vec2(idx % width, idx / width));
+        }
+        std::reverse(path.begin(), path.end());
+        for (int idx = tables.getParent(1, meet); idx >= 0; idx = tables.getParent(1, idx)) {
+            path.push_back(cocos2d::Vec2(idx % width, idx / width));
+        }
+        return true;
+    }
+}
+
+#endif /* defined(__Funny_PathFinding__Bidirectional__) */
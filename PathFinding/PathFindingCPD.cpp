@@ -0,0 +1,435 @@
+/****************************************************************************
+ Copyright (c) 2015 QuanNguyen
+ 
+ http://quannguyen.info
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+
+#include "PathFindingCPD.h"
+
+#include <thread>
+#include <atomic>
+
+#if !defined(_WIN32)
+#include <sys/mman.h>
+#endif
+
+USING_NS_CC;
+
+namespace pathfinding {
+    
+    namespace cpd {
+        
+        static const uint32_t kFileMagic = 0x31445043; // "CPD1"
+        static const int kBlockSize = 64; // sources per thread job
+        
+        static const int kMoveX[8] = {0, 0, -1, 1, 1, 1, -1, -1};
+        static const int kMoveY[8] = {-1, 1, 0, 0, -1, 1, -1, 1};
+        
+        struct FileHeader {
+            uint32_t magic;
+            uint32_t width;
+            uint32_t height;
+            uint32_t nodeCount;
+            uint32_t checksum;
+            uint32_t reserved;
+            uint64_t runCount;
+        };
+        
+        /**
+         *  same rule as dijkstra::PathFinding::getNearbyTileCoord: no corner cutting
+         */
+        static bool canMove(CollisionData* map, int x, int y, int move)
+        {
+            int nx = x + kMoveX[move];
+            int ny = y + kMoveY[move];
+            if(nx < 0 || ny < 0 || nx >= (int)map->getWidth() || ny >= (int)map->getHeight()){
+                return false;
+            }
+            if(map->haveCollisionAtCoord(nx, ny)){
+                return false;
+            }
+            if(move >= MOVE_TOP_RIGHT){
+                return !map->haveCollisionAtCoord(nx, y) && !map->haveCollisionAtCoord(x, ny);
+            }
+            return true;
+        }
+        
+        static size_t computeRanksOffset()
+        {
+            return sizeof(FileHeader);
+        }
+        
+        static size_t computeOffsetsOffset(int width, int height)
+        {
+            size_t end = computeRanksOffset() + (size_t)width * height * sizeof(int32_t);
+            return (end + 7) & ~(size_t)7;
+        }
+        
+        CompressedPathDatabase::CompressedPathDatabase() :
+        _ranks(nullptr),
+        _offsets(nullptr),
+        _runs(nullptr),
+        _mappedData(nullptr),
+        _mappedSize(0),
+        _map(nullptr),
+        _width(0),
+        _height(0),
+        _nodeCount(0),
+        _runCount(0)
+        {
+            
+        }
+        
+        CompressedPathDatabase::~CompressedPathDatabase()
+        {
+            releaseData();
+        }
+        
+        void CompressedPathDatabase::releaseData()
+        {
+            if(_mappedData){
+#if !defined(_WIN32)
+                munmap(_mappedData, _mappedSize);
+#endif
+                _mappedData = nullptr;
+                _mappedSize = 0;
+            }
+            _fileStorage.clear();
+            _rankStorage.clear();
+            _offsetStorage.clear();
+            _runStorage.clear();
+            _ranks = nullptr;
+            _offsets = nullptr;
+            _runs = nullptr;
+            _nodeCount = 0;
+            _runCount = 0;
+        }
+        
+        void CompressedPathDatabase::computeOrdering()
+        {
+            // depth first ordering, neighbour tiles get close ranks so they share runs
+            _rankStorage.assign((size_t)_width * _height, -1);
+            _nodeCount = 0;
+            
+            std::vector<ssize_t> stack;
+            for (ssize_t i = 0; i < (ssize_t)_rankStorage.size(); i ++) {
+                if(_rankStorage[i] >= 0 || _map->haveCollisionAtCoord(i % _width, i / _width)){
+                    continue;
+                }
+                stack.push_back(i);
+                while (!stack.empty()) {
+                    ssize_t pos = stack.back();
+                    stack.pop_back();
+                    if(_rankStorage[pos] >= 0){
+                        continue;
+                    }
+                    _rankStorage[pos] = _nodeCount ++;
+                    
+                    int x = pos % _width;
+                    int y = pos / _width;
+                    for (int m = MOVE_BOTTOM_LEFT; m >= MOVE_TOP; m --) {
+                        if(canMove(_map, x, y, m)){
+                            ssize_t npos = (x + kMoveX[m]) + (ssize_t)(y + kMoveY[m]) * _width;
+                            if(_rankStorage[npos] < 0){
+                                stack.push_back(npos);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+        
+        bool CompressedPathDatabase::initWithMap(CollisionData *map, int numThreads)
+        {
+            CCASSERT(map, "Map must be not null");
+            
+            releaseData();
+            _map = map;
+            _width = map->getWidth();
+            _height = map->getHeight();
+            
+            computeOrdering();
+            if(_nodeCount == 0){
+                return false;
+            }
+            
+            // graph in rank space
+            int nodeCount = _nodeCount;
+            std::vector<int32_t> neighbours((size_t)nodeCount * 8, -1);
+            for (ssize_t pos = 0; pos < (ssize_t)_rankStorage.size(); pos ++) {
+                int32_t rank = _rankStorage[pos];
+                if(rank < 0){
+                    continue;
+                }
+                int x = pos % _width;
+                int y = pos / _width;
+                for (int m = MOVE_TOP; m < MOVE_NONE; m ++) {
+                    if(canMove(_map, x, y, m)){
+                        neighbours[(size_t)rank * 8 + m] = _rankStorage[(x + kMoveX[m]) + (ssize_t)(y + kMoveY[m]) * _width];
+                    }
+                }
+            }
+            
+            if(numThreads <= 0){
+                numThreads = std::max(1u, std::thread::hardware_concurrency());
+            }
+            
+            int blockCount = (nodeCount + kBlockSize - 1) / kBlockSize;
+            std::vector<std::vector<uint32_t> > blockRuns(blockCount);
+            std::vector<uint32_t> rowRunCount(nodeCount);
+            std::atomic<int> nextBlock(0);
+            
+            auto job = [&]() {
+                // search state owned by the thread
+                std::vector<double> dist(nodeCount);
+                std::vector<uint8_t> firstMove(nodeCount);
+                std::vector<std::pair<double, int32_t> > heap;
+                std::greater<std::pair<double, int32_t> > cmp;
+                
+                int block;
+                while ((block = nextBlock++) < blockCount) {
+                    std::vector<uint32_t>& runs = blockRuns[block];
+                    int end = std::min(nodeCount, (block + 1) * kBlockSize);
+                    for (int source = block * kBlockSize; source < end; source ++) {
+                        std::fill(dist.begin(), dist.end(), DBL_MAX);
+                        std::fill(firstMove.begin(), firstMove.end(), (uint8_t)MOVE_NONE);
+                        heap.clear();
+                        
+                        dist[source] = 0;
+                        heap.push_back(std::make_pair(0.0, source));
+                        while (!heap.empty()) {
+                            std::pop_heap(heap.begin(), heap.end(), cmp);
+                            double d = heap.back().first;
+                            int32_t u = heap.back().second;
+                            heap.pop_back();
+                            if(d > dist[u]){
+                                continue;
+                            }
+                            for (int m = MOVE_TOP; m < MOVE_NONE; m ++) {
+                                int32_t v = neighbours[(size_t)u * 8 + m];
+                                if(v < 0){
+                                    continue;
+                                }
+                                double nd = d + (m < MOVE_TOP_RIGHT ? 1.0 : M_SQRT2);
+                                if(nd < dist[v]){
+                                    dist[v] = nd;
+                                    firstMove[v] = (u == source) ? m : firstMove[u];
+                                    heap.push_back(std::make_pair(nd, v));
+                                    std::push_heap(heap.begin(), heap.end(), cmp);
+                                }
+                            }
+                        }
+                        
+                        // run-length encode the row, the source itself is never queried so it join any run
+                        size_t rowBegin = runs.size();
+                        int lastMove = -1;
+                        for (int target = 0; target < nodeCount; target ++) {
+                            if(target == source || firstMove[target] == lastMove){
+                                continue;
+                            }
+                            lastMove = firstMove[target];
+                            uint32_t start = (runs.size() == rowBegin) ? 0 : target;
+                            runs.push_back((start << 4) | lastMove);
+                        }
+                        if(runs.size() == rowBegin){
+                            runs.push_back(MOVE_NONE);
+                        }
+                        rowRunCount[source] = runs.size() - rowBegin;
+                    }
+                }
+            };
+            
+            std::vector<std::thread> threads;
+            for (int i = 1; i < numThreads; i ++) {
+                threads.push_back(std::thread(job));
+            }
+            job();
+            for (auto& t : threads) {
+                t.join();
+            }
+            
+            _offsetStorage.resize(nodeCount + 1);
+            _offsetStorage[0] = 0;
+            for (int i = 0; i < nodeCount; i ++) {
+                _offsetStorage[i + 1] = _offsetStorage[i] + rowRunCount[i];
+            }
+            _runCount = _offsetStorage[nodeCount];
+            _runStorage.reserve(_runCount);
+            for (auto& runs : blockRuns) {
+                _runStorage.insert(_runStorage.end(), runs.begin(), runs.end());
+                std::vector<uint32_t>().swap(runs);
+            }
+            
+            _ranks = _rankStorage.data();
+            _offsets = _offsetStorage.data();
+            _runs = _runStorage.data();
+            
+            CCLOG("CompressedPathDatabase: %d nodes, %llu runs, %ld bytes", _nodeCount, (unsigned long long)_runCount, (long)getMemorySize());
+            
+            return true;
+        }
+        
+        bool CompressedPathDatabase::saveToFile(const std::string &fileName) const
+        {
+            if(!_ranks){
+                return false;
+            }
+            
+            FILE* fp = fopen(fileName.c_str(), "wb");
+            if(!fp){
+                return false;
+            }
+            
+            FileHeader header = {kFileMagic, (uint32_t)_width, (uint32_t)_height, (uint32_t)_nodeCount, _map->computeChecksum(), 0, _runCount};
+            size_t tileCount = (size_t)_width * _height;
+            size_t padding = computeOffsetsOffset(_width, _height) - computeRanksOffset() - tileCount * sizeof(int32_t);
+            uint64_t zero = 0;
+            
+            bool ok = fwrite(&header, sizeof(header), 1, fp) == 1
+                && fwrite(_ranks, sizeof(int32_t), tileCount, fp) == tileCount
+                && fwrite(&zero, 1, padding, fp) == padding
+                && fwrite(_offsets, sizeof(uint64_t), _nodeCount + 1, fp) == (size_t)_nodeCount + 1
+                && fwrite(_runs, sizeof(uint32_t), _runCount, fp) == _runCount;
+            fclose(fp);
+            
+            return ok;
+        }
+        
+        bool CompressedPathDatabase::initWithFile(CollisionData *map, const std::string &fileName)
+        {
+            CCASSERT(map, "Map must be not null");
+            
+            releaseData();
+            _map = map;
+            _width = map->getWidth();
+            _height = map->getHeight();
+            
+            FILE* file = fopen(fileName.c_str(), "rb");
+            if(!file){
+                return false;
+            }
+            fseek(file, 0, SEEK_END);
+            long fileSize = ftell(file);
+            if(fileSize < (long)sizeof(FileHeader)){
+                fclose(file);
+                return false;
+            }
+            
+            const void* data = nullptr;
+#if !defined(_WIN32)
+            void* mapped = mmap(nullptr, fileSize, PROT_READ, MAP_SHARED, fileno(file), 0);
+            if(mapped != MAP_FAILED){
+                _mappedData = mapped;
+                _mappedSize = fileSize;
+                data = mapped;
+            }
+#endif
+            if(!data){
+                // read at once, in 8 bytes words to keep the alignment of the tables
+                _fileStorage.resize((fileSize + sizeof(uint64_t) - 1) / sizeof(uint64_t));
+                fseek(file, 0, SEEK_SET);
+                if(fread(_fileStorage.data(), 1, fileSize, file) != (size_t)fileSize){
+                    fclose(file);
+                    releaseData();
+                    return false;
+                }
+                data = _fileStorage.data();
+            }
+            fclose(file);
+            
+            const FileHeader* header = (const FileHeader*)data;
+            size_t offsetsOffset = computeOffsetsOffset(_width, _height);
+            size_t expectedSize = offsetsOffset + ((size_t)header->nodeCount + 1) * sizeof(uint64_t) + header->runCount * sizeof(uint32_t);
+            if(header->magic != kFileMagic
+               || header->width != (uint32_t)_width
+               || header->height != (uint32_t)_height
+               || expectedSize != (size_t)fileSize
+               || header->checksum != _map->computeChecksum()){
+                CCLOG("CompressedPathDatabase: %s does not match the map", fileName.c_str());
+                releaseData();
+                return false;
+            }
+            
+            _nodeCount = header->nodeCount;
+            _runCount = header->runCount;
+            _ranks = (const int32_t*)((const char*)data + computeRanksOffset());
+            _offsets = (const uint64_t*)((const char*)data + offsetsOffset);
+            _runs = (const uint32_t*)(_offsets + _nodeCount + 1);
+            
+            return true;
+        }
+        
+        Move CompressedPathDatabase::getFirstMove(int fromX, int fromY, int toX, int toY) const
+        {
+            if(!_ranks
+               || fromX < 0 || fromY < 0 || fromX >= _width || fromY >= _height
+               || toX < 0 || toY < 0 || toX >= _width || toY >= _height){
+                return MOVE_NONE;
+            }
+            
+            int32_t source = _ranks[fromX + (ssize_t)fromY * _width];
+            int32_t target = _ranks[toX + (ssize_t)toY * _width];
+            if(source < 0 || target < 0 || source == target){
+                return MOVE_NONE;
+            }
+            
+            // last run starting at or before the target
+            const uint32_t* begin = _runs + _offsets[source];
+            const uint32_t* end = _runs + _offsets[source + 1];
+            const uint32_t* ite = std::upper_bound(begin, end, ((uint32_t)target << 4) | 0xF);
+            return (Move)(*(ite - 1) & 0xF);
+        }
+        
+        std::vector<Vec2> CompressedPathDatabase::getShortestPath(const cocos2d::Vec2 &fromCoord, const cocos2d::Vec2 &toCoord) const
+        {
+            std::vector<Vec2> result;
+            if(fromCoord.equals(toCoord)){
+                return result;
+            }
+            
+            int x = fromCoord.x;
+            int y = fromCoord.y;
+            int toX = toCoord.x;
+            int toY = toCoord.y;
+            
+            result.push_back(fromCoord);
+            while (x != toX || y != toY) {
+                Move m = getFirstMove(x, y, toX, toY);
+                if(m == MOVE_NONE || (int)result.size() > _nodeCount){
+                    result.clear();
+                    break;
+                }
+                x += kMoveX[m];
+                y += kMoveY[m];
+                result.push_back(Vec2(x, y));
+            }
+            
+            return result;
+        }
+        
+        size_t CompressedPathDatabase::getMemorySize() const
+        {
+            return (size_t)_width * _height * sizeof(int32_t)
+                + ((size_t)_nodeCount + 1) * sizeof(uint64_t)
+                + _runCount * sizeof(uint32_t);
+        }
+    }
+}
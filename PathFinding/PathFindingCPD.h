@@ -0,0 +1,136 @@
+/****************************************************************************
+ Copyright (c) 2015 QuanNguyen
+ 
+ http://quannguyen.info
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+
+#ifndef __Funny_PathFinding__CPD__
+#define __Funny_PathFinding__CPD__
+
+#include "cocos2d.h"
+#include "CollisionData.h"
+
+namespace pathfinding {
+    
+    namespace cpd {
+        
+        /**
+         *  Moves, same order and same corner rule as dijkstra::PathFinding::getNearbyTileCoord
+         */
+        enum Move {
+            MOVE_TOP = 0,
+            MOVE_BOTTOM,
+            MOVE_LEFT,
+            MOVE_RIGHT,
+            MOVE_TOP_RIGHT,
+            MOVE_BOTTOM_RIGHT,
+            MOVE_TOP_LEFT,
+            MOVE_BOTTOM_LEFT,
+            MOVE_NONE
+        };
+        
+        /**
+         *  Compressed path database for static maps.
+         *
+         *  For every walkable source tile we store the optimal first move toward every target,
+         *  targets are numbered with a depth first ordering so close tiles share the same first move,
+         *  and every source row is run-length encoded. A path is then read move by move without search.
+         *
+         *  Build time: one Dijkstra per walkable tile, O(N^2 log N) for N walkable tiles,
+         *  split over the worker threads (ex: 128x128 open map ~ 16k searches of 16k nodes).
+         *
+         *  Memory: 4 bytes per tile (ordering) + 8 bytes per walkable tile (row offsets)
+         *          + 4 bytes per run, runs per row grow with the obstacle count not the map size.
+         *          use getRunCount() / getMemorySize() after build to get the real numbers of a map.
+         *
+         *  Query: O(log R) per move (binary search in the source row of R runs).
+         *
+         *  Only valid while the map does not change, the file keep a checksum of the map.
+         */
+        class CompressedPathDatabase
+        {
+        public:
+            CompressedPathDatabase();
+            virtual ~CompressedPathDatabase();
+            
+            /**
+             *  build the database
+             *  @param numThreads 0 will use the hardware concurrency
+             *  @return true if build successful
+             */
+            bool initWithMap(CollisionData* map, int numThreads = 0);
+            
+            /**
+             *  memory map a database saved with saveToFile (read at once without mmap), the map must be the one used to build it
+             *  @return true if load successful
+             */
+            bool initWithFile(CollisionData* map, const std::string& fileName);
+            
+            /**
+             *  save the database, usually next to the map image (ex: "map.png.cpd")
+             *  @return true if save successful
+             */
+            bool saveToFile(const std::string& fileName) const;
+            
+            /**
+             *  @return the first move of an optimal path, MOVE_NONE if no path or same tile
+             */
+            Move getFirstMove(int fromX, int fromY, int toX, int toY) const;
+            
+            /**
+             *  same contract as dijkstra::PathFinding::getShortestPath, without any search
+             */
+            std::vector<cocos2d::Vec2> getShortestPath(const cocos2d::Vec2& fromCoord,
+                                                       const cocos2d::Vec2& toCoord) const;
+            
+            /**
+             *  @return bytes used by the tables
+             */
+            size_t getMemorySize() const;
+            
+        protected:
+            // in memory storage, empty when the tables are memory mapped
+            std::vector<int32_t> _rankStorage;
+            std::vector<uint64_t> _offsetStorage;
+            std::vector<uint32_t> _runStorage;
+            
+            // tables used by the queries
+            const int32_t* _ranks;      // tile -> ordering rank, -1 for blocked tile
+            const uint64_t* _offsets;   // rank -> first run of the source row, nodeCount + 1 entries
+            const uint32_t* _runs;      // (first target rank << 4) | move
+            
+            void* _mappedData;
+            size_t _mappedSize;
+            std::vector<uint64_t> _fileStorage;     // the file read at once when it can't be mapped
+            
+            void computeOrdering();
+            void releaseData();
+            
+            CC_SYNTHESIZE_READONLY(CollisionData *, _map, Map);
+            CC_SYNTHESIZE_READONLY(int, _width, Width);
+            CC_SYNTHESIZE_READONLY(int, _height, Height);
+            CC_SYNTHESIZE_READONLY(int, _nodeCount, NodeCount);
+            CC_SYNTHESIZE_READONLY(uint64_t, _runCount, RunCount);
+        };
+    }
+}
+
+#endif /* defined(__Funny_PathFinding__CPD__) */
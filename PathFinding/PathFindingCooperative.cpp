@@ -0,0 +1,379 @@
+/****************************************************************************
+ Copyright (c) 2015 QuanNguyen
+ 
+ http://quannguyen.info
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+
+#include "PathFindingCooperative.h"
+#include <unordered_set>
+#include <queue>
+#include <climits>
+
+USING_NS_CC;
+
+#define DEBUG_PRINT 1
+
+namespace pathfinding {
+    
+    namespace cooperative {
+        
+        // a BFS table per goal, they are dropped when there are more
+        static const size_t kMaxCachedGoals = 64;
+        
+        const int ReservationTable::kNone;
+        
+        void ReservationTable::initWithSize(int width, int height)
+        {
+            _width = width;
+            _height = height;
+            clear();
+        }
+        
+        void ReservationTable::clear()
+        {
+            _reservations.clear();
+            _parked.clear();
+            _tileTimes.clear();
+            _agentKeys.clear();
+        }
+        
+        void ReservationTable::releaseAgent(int agent)
+        {
+            auto ite = _agentKeys.find(agent);
+            if(ite != _agentKeys.end()){
+                for (uint64_t key : ite->second) {
+                    _reservations.erase(key);
+                    
+                    std::vector<int>& times = _tileTimes[(int)(uint32_t)key];
+                    auto timeIte = std::find(times.begin(), times.end(), (int)(key >> 32));
+                    if(timeIte != times.end()){
+                        *timeIte = times.back();
+                        times.pop_back();
+                    }
+                }
+                _agentKeys.erase(ite);
+            }
+            
+            for (auto parkIte = _parked.begin(); parkIte != _parked.end(); ) {
+                if(parkIte->second.first == agent){
+                    parkIte = _parked.erase(parkIte);
+                }
+                else{
+                    parkIte ++;
+                }
+            }
+        }
+        
+        void ReservationTable::reserve(int x, int y, int time, int agent)
+        {
+            int tile = getIndex(x, y);
+            uint64_t key = makeKey(tile, time);
+            auto result = _reservations.insert(std::make_pair(key, agent));
+            if(!result.second){
+                CCASSERT(result.first->second == agent, "Tile already reserved by another agent");
+                return;
+            }
+            _tileTimes[tile].push_back(time);
+            _agentKeys[agent].push_back(key);
+        }
+        
+        void ReservationTable::park(int x, int y, int time, int agent)
+        {
+            _parked[getIndex(x, y)] = std::make_pair(agent, time);
+        }
+        
+        int ReservationTable::getOwner(int x, int y, int time) const
+        {
+            int tile = getIndex(x, y);
+            auto ite = _reservations.find(makeKey(tile, time));
+            if(ite != _reservations.end()){
+                return ite->second;
+            }
+            
+            auto parkIte = _parked.find(tile);
+            if(parkIte != _parked.end() && time >= parkIte->second.second){
+                return parkIte->second.first;
+            }
+            return kNone;
+        }
+        
+        bool ReservationTable::canMove(int fromX, int fromY, int toX, int toY, int time, int agent) const
+        {
+            if(!isFree(toX, toY, time + 1, agent)){
+                return false;
+            }
+            if(fromX == toX && fromY == toY){
+                return true;
+            }
+            
+            // an agent coming the other way would cross this one
+            int other = getOwner(toX, toY, time);
+            return other == kNone || other == agent || getOwner(fromX, fromY, time + 1) != other;
+        }
+        
+        int ReservationTable::getLastTime(int x, int y, int agent) const
+        {
+            int tile = getIndex(x, y);
+            auto parkIte = _parked.find(tile);
+            if(parkIte != _parked.end() && parkIte->second.first != agent){
+                return INT_MAX;
+            }
+            
+            int last = -1;
+            auto ite = _tileTimes.find(tile);
+            if(ite != _tileTimes.end()){
+                for (int time : ite->second) {
+                    if(time > last && getOwner(x, y, time) != agent){
+                        last = time;
+                    }
+                }
+            }
+            return last;
+        }
+        
+        PathFinding::PathFinding() :
+        _distancesVersion(0),
+        _map(nullptr),
+        _window(0),
+        _maxDelay(64)
+        {
+            
+        }
+        
+        PathFinding::~PathFinding()
+        {
+            
+        }
+        
+        bool PathFinding::init()
+        {
+            return true;
+        }
+        
+        void PathFinding::setupMap(CollisionData *map)
+        {
+            CCASSERT(map, "Map must be not null");
+            _map = map;
+            _reservations.initWithSize(map->getWidth(), map->getHeight());
+            _distances.clear();
+            _distancesVersion = map->getVersion();
+        }
+        
+        const std::vector<int>& PathFinding::getTrueDistances(int goal)
+        {
+            if(_distancesVersion != _map->getVersion() || _distances.size() >= kMaxCachedGoals){
+                _distances.clear();
+                _distancesVersion = _map->getVersion();
+            }
+            
+            auto ite = _distances.find(goal);
+            if(ite != _distances.end()){
+                return ite->second;
+            }
+            
+            // BFS from the goal on the map only: the overlays change too often, without them
+            // the distance is still a lower bound
+            int width = _map->getWidth();
+            int height = _map->getHeight();
+            std::vector<int>& distances = _distances[goal];
+            distances.assign((size_t)width * height, -1);
+            
+            std::vector<int> queue;
+            queue.reserve(distances.size());
+            queue.push_back(goal);
+            distances[goal] = 0;
+            
+            static const int dx[] = {0, 0, -1, 1};
+            static const int dy[] = {-1, 1, 0, 0};
+            for (size_t i = 0; i < queue.size(); i++) {
+                int cur = queue[i];
+                int cx = cur % width;
+                int cy = cur / width;
+                for (int k = 0; k < 4; k++) {
+                    int nx = cx + dx[k];
+                    int ny = cy + dy[k];
+                    if(nx < 0 || ny < 0 || nx >= width || ny >= height || _map->haveCollisionAtCoord(nx, ny)){
+                        continue;
+                    }
+                    int next = nx + ny * width;
+                    if(distances[next] < 0){
+                        distances[next] = distances[cur] + 1;
+                        queue.push_back(next);
+                    }
+                }
+            }
+            return distances;
+        }
+        
+        std::vector<Vec2> PathFinding::getShortestPath(int agent,
+                                                       const cocos2d::Vec2 &fromCoord,
+                                                       const cocos2d::Vec2 &toCoord,
+                                                       int startTime)
+        {
+#if DEBUG_PRINT
+            CCLOG("*** PATH SEARCH BEGIN : cooperative A* agent %d", agent);
+#endif
+            std::vector<Vec2> result;
+            _reservations.releaseAgent(agent);
+            _stats = SearchStats();
+            
+            if(!isFree(fromCoord.x, fromCoord.y) || !isFree(toCoord.x, toCoord.y)){
+                return result;
+            }
+            if(!_reservations.isFree(fromCoord.x, fromCoord.y, startTime, agent)){
+                return result;
+            }
+            
+            int width = _map->getWidth();
+            int start = fromCoord.x + fromCoord.y * width;
+            int goal = toCoord.x + toCoord.y * width;
+            const std::vector<int>& distances = getTrueDistances(goal);
+            if(distances[start] < 0){
+                return result;
+            }
+            
+            // plan until the horizon, without window the goal can only be the end once no other agent use it
+            int horizon = startTime + (_window > 0 ? _window : distances[start] + _maxDelay);
+            int goalLastTime = _window > 0 ? -1 : _reservations.getLastTime(toCoord.x, toCoord.y, agent);
+            if(goalLastTime >= horizon){
+                return result;
+            }
+            
+            // open list ordered by f, then the latest time first
+            typedef std::pair<std::pair<int, int>, int> OpenEntry;
+            std::priority_queue<OpenEntry, std::vector<OpenEntry>, std::greater<OpenEntry> > open;
+            std::unordered_set<uint64_t> seen;
+            std::vector<Node> nodes;
+            
+            Node first = {start, startTime, -1};
+            nodes.push_back(first);
+            seen.insert(((uint64_t)(uint32_t)startTime << 32) | (uint32_t)start);
+            open.push(OpenEntry(std::make_pair(distances[start], -startTime), 0));
+            
+            static const int dx[] = {0, 0, 0, -1, 1};
+            static const int dy[] = {0, -1, 1, 0, 0};
+            int found = -1;
+            
+            while (!open.empty()) {
+                int current = open.top().second;
+                open.pop();
+                _stats.forwardExpansions ++;
+                
+                Node node = nodes[current];
+                int x = node.tile % width;
+                int y = node.tile / width;
+                
+                if(node.tile == goal){
+                    bool canStay = node.time > goalLastTime;
+                    for (int t = node.time + 1; canStay && _window > 0 && t <= horizon; t++) {
+                        canStay = _reservations.isFree(x, y, t, agent);
+                    }
+                    if(canStay){
+                        found = current;
+                        break;
+                    }
+                }
+                if(node.time >= horizon){
+                    if(_window > 0){
+                        // the rest of the way is left to the next plan
+                        found = current;
+                        break;
+                    }
+                    continue;
+                }
+                
+                // wait, top, bottom, left, right
+                for (int k = 0; k < 5; k++) {
+                    int nx = x + dx[k];
+                    int ny = y + dy[k];
+                    if(!isFree(nx, ny)){
+                        continue;
+                    }
+                    int next = nx + ny * width;
+                    if(distances[next] < 0 || !_reservations.canMove(x, y, nx, ny, node.time, agent)){
+                        continue;
+                    }
+                    
+                    // every action cost 1 so the time give the G score, a state is only pushed once
+                    int time = node.time + 1;
+                    if(!seen.insert(((uint64_t)(uint32_t)time << 32) | (uint32_t)next).second){
+                        continue;
+                    }
+                    Node child = {next, time, current};
+                    nodes.push_back(child);
+                    open.push(OpenEntry(std::make_pair(time - startTime + distances[next], -time), (int)nodes.size() - 1));
+                }
+            }
+            
+#if DEBUG_PRINT
+            CCLOG("*** PATH SEARCH END : %s, %d expansions", found >= 0 ? "found" : "no path", _stats.forwardExpansions);
+#endif
+            if(found < 0){
+                return result;
+            }
+            
+            for (int idx = found; idx >= 0; idx = nodes[idx].parent) {
+                result.push_back(Vec2(nodes[idx].tile % width, nodes[idx].tile / width));
+            }
+            std::reverse(result.begin(), result.end());
+            
+            // reserve the plan, an agent at its goal keep the tile
+            for (size_t i = 0; i < result.size(); i++) {
+                _reservations.reserve(result[i].x, result[i].y, startTime + (int)i, agent);
+            }
+            int endTime = startTime + (int)result.size() - 1;
+            if(result.back().equals(toCoord)){
+                if(_window > 0){
+                    for (int t = endTime + 1; t <= horizon; t++) {
+                        _reservations.reserve(toCoord.x, toCoord.y, t, agent);
+                    }
+                }
+                else{
+                    _reservations.park(toCoord.x, toCoord.y, endTime, agent);
+                }
+            }
+            return result;
+        }
+        
+        std::vector<std::vector<Vec2> > PathFinding::getShortestPaths(const std::vector<cocos2d::Vec2> &fromCoords,
+                                                                      const std::vector<cocos2d::Vec2> &toCoords,
+                                                                      int startTime)
+        {
+            CCASSERT(fromCoords.size() == toCoords.size(), "One goal per agent");
+            
+            // the agents planned first must not go through the tiles where the others start:
+            // each start is parked until getShortestPath release it to plan its agent
+            for (size_t i = 0; i < fromCoords.size(); i++) {
+                int agent = (int)i;
+                _reservations.releaseAgent(agent);
+                if(_reservations.isFree(fromCoords[i].x, fromCoords[i].y, startTime, agent)){
+                    _reservations.park(fromCoords[i].x, fromCoords[i].y, startTime, agent);
+                }
+            }
+            
+            std::vector<std::vector<Vec2> > result;
+            for (size_t i = 0; i < fromCoords.size(); i++) {
+                result.push_back(getShortestPath((int)i, fromCoords[i], toCoords[i], startTime));
+            }
+            return result;
+        }
+    }
+}
@@ -0,0 +1,211 @@
+/****************************************************************************
+ Copyright (c) 2015 QuanNguyen
+ 
+ http://quannguyen.info
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+
+#ifndef __Funny_PathFinding__Cooperative__
+#define __Funny_PathFinding__Cooperative__
+
+#include "cocos2d.h"
+#include "CollisionData.h"
+#include "CollisionOverlay.h"
+#include "PathFindingBidirectional.h"
+#include <unordered_map>
+
+namespace pathfinding {
+    
+    namespace cooperative {
+        
+        /**
+         *  Tiles reserved by the agents at every time step, shared by all the agents of a planner.
+         *  A hash of (tile, time) -> agent, an agent which reached its goal can also be parked:
+         *  its tile is then reserved from a time on.
+         */
+        class ReservationTable {
+            
+        public:
+            static const int kNone = -1;
+            
+            ReservationTable() :
+            _width(0),
+            _height(0)
+            {
+            };
+            
+            void initWithSize(int width, int height);
+            
+            /**
+             *  release every reservation
+             */
+            void clear();
+            
+            /**
+             *  release the reservations of an agent (before it plan again)
+             */
+            void releaseAgent(int agent);
+            
+            void reserve(int x, int y, int time, int agent);
+            
+            /**
+             *  reserve the tile from time to forever
+             */
+            void park(int x, int y, int time, int agent);
+            
+            /**
+             *  @return the agent on the tile at time, kNone if free
+             */
+            int getOwner(int x, int y, int time) const;
+            
+            inline bool isFree(int x, int y, int time, int agent) const {
+                int owner = getOwner(x, y, time);
+                return owner == kNone || owner == agent;
+            }
+            
+            /**
+             *  @return true if the agent can go from (fromX, fromY) at time to (toX, toY) at time + 1:
+             *  the destination is free and no agent come the other way (swap)
+             */
+            bool canMove(int fromX, int fromY, int toX, int toY, int time, int agent) const;
+            
+            /**
+             *  last time the tile is reserved by another agent than agent, -1 if never, INT_MAX if parked
+             */
+            int getLastTime(int x, int y, int agent) const;
+            
+            inline size_t getReservationCount() const {
+                return _reservations.size() + _parked.size();
+            }
+            
+        protected:
+            std::unordered_map<uint64_t, int> _reservations;        // (time, tile) -> agent
+            std::unordered_map<int, std::pair<int, int> > _parked;  // tile -> (agent, from time)
+            std::unordered_map<int, std::vector<int> > _tileTimes;  // tile -> times reserved
+            std::unordered_map<int, std::vector<uint64_t> > _agentKeys;
+            
+            inline int getIndex(int x, int y) const {
+                return x + y * _width;
+            }
+            
+            static inline uint64_t makeKey(int tile, int time) {
+                return ((uint64_t)(uint32_t)time << 32) | (uint32_t)tile;
+            }
+            
+            CC_SYNTHESIZE_READONLY(int, _width, Width);
+            CC_SYNTHESIZE_READONLY(int, _height, Height);
+        };
+        
+        /**
+         *  Cooperative A*: agents plan one after the other in (x, y, time) against the reservation
+         *  table, so the paths of the agents never share a tile at the same time nor swap tiles.
+         *  Moves are the 4 neighbours (same as Astar::PathFinding) and waiting, all cost 1 step.
+         *
+         *  The heuristic is the true distance to the goal on the map (one BFS per goal, cached),
+         *  so only the conflicts with other agents make the search expand more than the path.
+         *
+         *  With a window of N steps (windowed hierarchical cooperative A*) an agent only reserve
+         *  its next N steps and must plan again before they run out, the cost of a plan stays bounded.
+         */
+        class PathFinding : public cocos2d::Ref {
+            
+        public:
+            
+            PathFinding();
+            virtual ~PathFinding();
+            
+            CREATE_FUNC(PathFinding);
+            
+            /**
+             *  the reservations are cleared
+             */
+            void setupMap(CollisionData* map);
+            
+            /**
+             *  plan one agent and reserve its path, its previous reservations are released first
+             *  @return one tile per time step from startTime (a wait repeat the tile), empty if no plan
+             */
+            std::vector<cocos2d::Vec2> getShortestPath(int agent,
+                                                       const cocos2d::Vec2& fromCoord,
+                                                       const cocos2d::Vec2& toCoord,
+                                                       int startTime = 0);
+            
+            /**
+             *  plan the agents in priority order, agent i go from fromCoords[i] to toCoords[i]
+             *  the start tiles are kept for their agent, an agent can't go through nor end on the start of a later one
+             */
+            std::vector<std::vector<cocos2d::Vec2> > getShortestPaths(const std::vector<cocos2d::Vec2>& fromCoords,
+                                                                      const std::vector<cocos2d::Vec2>& toCoords,
+                                                                      int startTime = 0);
+            
+            inline ReservationTable& getReservationTable() {
+                return _reservations;
+            }
+            
+        protected:
+            virtual bool init();
+            
+            struct Node {
+                int tile;
+                int time;
+                int parent;
+            };
+            
+            /**
+             *  distance to the goal of every tile, -1 if it can't be reached
+             */
+            const std::vector<int>& getTrueDistances(int goal);
+            
+            inline bool isFree(int x, int y){
+                return (x >= 0 && x < (int)_map->getWidth() && y >= 0 && y < (int)_map->getHeight()
+                        && !_map->haveCollisionAtCoord(x, y)
+                        && !CollisionOverlay::isBlocked(_overlays, x, y));
+            }
+            
+            ReservationTable _reservations;
+            std::unordered_map<int, std::vector<int> > _distances;
+            unsigned int _distancesVersion;
+            
+            CC_SYNTHESIZE_READONLY(CollisionData *, _map, Map);
+            
+            /**
+             *  number of steps planned and reserved by a query, 0 to plan until the goal (default)
+             */
+            CC_SYNTHESIZE(int, _window, Window);
+            
+            /**
+             *  steps of waiting allowed on top of the true distance before a plan fail, 64 by default
+             */
+            CC_SYNTHESIZE(int, _maxDelay, MaxDelay);
+            
+            /**
+             *  tiles blocked by these overlays can't be used, empty by default
+             */
+            CC_SYNTHESIZE_PASS_BY_REF(std::vector<CollisionOverlay *>, _overlays, Overlays);
+            
+            /**
+             *  work done by the last getShortestPath, the expansions are (x, y, time) states
+             */
+            CC_SYNTHESIZE_READONLY_PASS_BY_REF(SearchStats, _stats, Stats);
+        };
+    }
+}
+
+#endif /* defined(__Funny_PathFinding__Cooperative__) */
@@ -24,6 +24,9 @@
 
 
 #include "PathFindingDijkstra.h"
+#include "CollisionChunks.h"
+
+#include <queue>
 
 USING_NS_CC;
 
@@ -33,18 +36,20 @@ namespace pathfinding {
     
     namespace dijkstra {
         
-        PathFinding::PathFinding()
+        PathFinding::PathFinding() :
+        _map(nullptr),
+        _agentSize(1),
+        _bidirectional(false),
+        _recorder(nullptr),
+        _graphVersion(0),
+        _graphReady(false)
         {
             
         }
         
         PathFinding::~PathFinding()
         {
-            for (auto ite = _graph.begin(); ite != _graph.end(); ite ++) {
-                delete *ite;
-            }
-            
-            _graph.clear();
+            clearGraph();
         }
         
         bool PathFinding::init()
@@ -56,23 +61,65 @@ namespace pathfinding {
         {
             CCASSERT(map, "Map must be not null");
             _map = map;
+            _nearest.setupMap(map);
+            if(_recorder){
+                _recorder->registerMap(map);
+            }
             
-            //re generate the graph
+            // the graph is generated by the next search
+            clearGraph();
+            _graphReady = false;
+        }
+        
+        void PathFinding::setRecorder(trace::TraceRecorder *recorder)
+        {
+            _recorder = recorder;
+            if(_recorder && _map){
+                _recorder->registerMap(_map);
+            }
+        }
+        
+        void PathFinding::clearGraph()
+        {
             for (auto ite = _graph.begin(); ite != _graph.end(); ite ++) {
                 delete *ite;
             }
             _graph.clear();
-            
+            _vertexIndexes.clear();
+        }
+        
+        void PathFinding::updateGraph()
+        {
+            // the graph only know the tiles free when it was generated
+            if(_graphReady && _graphVersion == _map->getVersion()){
+                return;
+            }
+            clearGraph();
             generateGraph();
+            _graphVersion = _map->getVersion();
+            _graphReady = true;
         }
         
         void PathFinding::generateGraph()
         {
-            for (int x = 0; x < _map->getWidth(); x ++) {
-                for (int y = 0; y < _map->getHeight(); y ++) {
-                    if(!_map->haveCollisionAtCoord(x, y)){
-                        Vertex *v = new Vertex(Vec2(x, y));
-                        _graph.push_back(v);
+            int width = _map->getWidth();
+            int height = _map->getHeight();
+            _vertexIndexes.assign((size_t)width * height, -1);
+            for (int x = 0; x < width; x ++) {
+                for (int y = 0; y < height; ) {
+                    // with LAYOUT_CHUNKED the uniform chunks are added or skipped without reading their tiles
+                    int chunkEnd = std::min(height, (y | (CollisionChunks::kChunkSize - 1)) + 1);
+                    CollisionData::ChunkState state = _map->getChunkState(x, y);
+                    if(state == CollisionData::CHUNK_BLOCKED || state == CollisionData::CHUNK_UNLOADED){
+                        y = chunkEnd;
+                        continue;
+                    }
+                    for (; y < chunkEnd; y ++) {
+                        if(state == CollisionData::CHUNK_FREE || !_map->haveCollisionAtCoord(x, y)){
+                            Vertex *v = new Vertex(Vec2(x, y));
+                            _vertexIndexes[x + (size_t)y * width] = (int32_t)_graph.size();
+                            _graph.push_back(v);
+                        }
                     }
                 }
             }
@@ -81,6 +128,26 @@ namespace pathfinding {
         std::vector<Vec2> PathFinding::getNearbyTileCoord(const cocos2d::Vec2 &tileCoord)
         {
             std::vector<Vec2> result;
+            
+            // a tile agent only need the 3x3 free bits of the map less the ones blocked by the overlays
+            if(_agentSize <= 1){
+                // top, bottom, left, right, top right, bottom right, top left, bottom left
+                static const int dx[] = {0, 0, -1, 1, 1, 1, -1, -1};
+                static const int dy[] = {-1, 1, 0, 0, -1, 1, -1, 1};
+                unsigned int mask = _map->getNeighbourMask(tileCoord.x, tileCoord.y);
+                if(!_overlays.empty()){
+                    mask &= ~CollisionOverlay::getNeighbourMask(_overlays, tileCoord.x, tileCoord.y);
+                }
+                for (int i = 0; i < 8; i ++) {
+                    if(CollisionData::isNeighbourFree(mask, dx[i], dy[i]) &&
+                       CollisionData::isNeighbourFree(mask, dx[i], 0) &&
+                       CollisionData::isNeighbourFree(mask, 0, dy[i])){
+                        result.push_back(Vec2(tileCoord.x + dx[i], tileCoord.y + dy[i]));
+                    }
+                }
+                return result;
+            }
+            
             //top
             Vec2 top = Vec2(tileCoord.x, tileCoord.y - 1);
             if(isValidCoord(top) && canMoveAtCoord(top)){
@@ -157,25 +224,108 @@ namespace pathfinding {
         
         std::vector<Vec2> PathFinding::getShortestPath(const cocos2d::Vec2 &fromCoord, const cocos2d::Vec2 &toCoord)
         {
+            trace::TraceQuery query(_recorder, _map, trace::TRACE_ENGINE_DIJKSTRA, _bidirectional, _agentSize, fromCoord, toCoord);
+            std::vector<Vec2> result;
+            if(_bidirectional){
+                findPathBidirectional(fromCoord, toCoord, result);
+                query.finish(result);
+                return result;
+            }
+            
+            Vertex *to = findPath(fromCoord, toCoord);
+            
+            // Walk the parents back to the start, then reverse once
+            for (; to != nullptr; to = to->getParent()) {
+                result.push_back(to->getPosition());
+            }
+            std::reverse(result.begin(), result.end());
+            
+            query.finish(result);
+            return result;
+        }
+        
+        bool PathFinding::getShortestPath(const cocos2d::Vec2 &fromCoord, const cocos2d::Vec2 &toCoord, PathBuffer &result)
+        {
+            trace::TraceQuery query(_recorder, _map, trace::TRACE_ENGINE_DIJKSTRA, _bidirectional, _agentSize, fromCoord, toCoord);
+            if(_bidirectional){
+                std::vector<Vec2> path;
+                findPathBidirectional(fromCoord, toCoord, path);
+                result.clear();
+                for (auto& coord : path) {
+                    result.push(coord.x, coord.y);
+                }
+                query.finish(result);
+                return !result.empty();
+            }
+            
+            result.beginReverse();
+            Vertex *to = findPath(fromCoord, toCoord);
+            
+            for (; to != nullptr; to = to->getParent()) {
+                result.pushReverse(to->getPosition().x, to->getPosition().y);
+            }
+            result.endReverse();
+            
+            query.finish(result);
+            return !result.empty();
+        }
+        
+        std::vector<Vec2> PathFinding::getShortestPathToNearest(const cocos2d::Vec2 &fromCoord,
+                                                                const cocos2d::Vec2 &toCoord,
+                                                                cocos2d::Vec2 *resolvedGoal)
+        {
+            Vec2 goal;
+            bool valid = _nearest.resolve(fromCoord, toCoord, _agentSize, goal);
+            if(resolvedGoal){
+                *resolvedGoal = goal;
+            }
+            if(!valid){
+                return std::vector<Vec2>();
+            }
+            return getShortestPath(fromCoord, goal);
+        }
+        
+        bool PathFinding::getShortestPathToNearest(const cocos2d::Vec2 &fromCoord,
+                                                   const cocos2d::Vec2 &toCoord,
+                                                   PathBuffer &result,
+                                                   cocos2d::Vec2 *resolvedGoal)
+        {
+            Vec2 goal;
+            bool valid = _nearest.resolve(fromCoord, toCoord, _agentSize, goal);
+            if(resolvedGoal){
+                *resolvedGoal = goal;
+            }
+            if(!valid){
+                result.clear();
+                return false;
+            }
+            return getShortestPath(fromCoord, goal, result);
+        }
+        
+        Vertex* PathFinding::findPath(const cocos2d::Vec2 &fromCoord, const cocos2d::Vec2 &toCoord)
+        {
 #if DEBUG_PRINT
             CCLOG("*** PATH SEARCH BEGIN : dijkstra");
 #endif
-            std::vector<Vec2> result;
+            _stats = SearchStats();
+            
             // Check that there is a path to compute ;-)
             if(fromCoord.equals(toCoord)){
-                return result;
+                return nullptr;
             }
             
             if(!isValidCoord(fromCoord) || !canMoveAtCoord(fromCoord)){
-                return result;
+                return nullptr;
             }
             
             // Must check that the desired location is walkable
             // In our case it's really easy, because only wall are unwalkable
             if(!isValidCoord(toCoord) || !canMoveAtCoord(toCoord)){
-                return result;
+                return nullptr;
             }
             
+            updateGraph();
+            
 #if DEBUG_PRINT
             CCLOG("num of vertex = %ld", _graph.size());
 #endif
@@ -188,65 +338,234 @@ namespace pathfinding {
             _openList.clear();
             
             //start at first position
-            auto startInGraph = *getIte(_graph, fromCoord);
+            auto startInGraph = getVertex(fromCoord);
+            if(!startInGraph){
+                return nullptr;
+            }
             startInGraph->setParent(nullptr);
             startInGraph->setWeight(0.0f);
             
-            do{
+            while (true) {
+                if(_cancelCheck && _cancelCheck()){
+                    _stats.cancelled = true;
+                    return nullptr;
+                }
+                
                 startInGraph->setMarked(true);
+                _stats.forwardExpansions ++;
+                if(startInGraph->getPosition().equals(toCoord)){
+                    break;
+                }
                 
                 //push all nearby vertex to open list (if it not in close list)
                 auto nearbyVertex = getNearbyTileCoord(startInGraph->getPosition());
                 for (auto ite = nearbyVertex.begin(); ite != nearbyVertex.end(); ite ++) {
-                    auto findIteInGraph = getIte(_graph, *ite);
-                    auto vertexInGraph = *findIteInGraph;
-                    if(!vertexInGraph->getMarked() && !contains(_openList, vertexInGraph)){
+                    auto vertexInGraph = getVertex(*ite);
+                    if(vertexInGraph && !vertexInGraph->getMarked()){
                         float lengthFromStart = (startInGraph->getPosition() - vertexInGraph->getPosition()).length();
                         auto weight = startInGraph->getWeight() + lengthFromStart;
-                        insertIntoOpenList(vertexInGraph, weight);
                         
                         if(vertexInGraph->getWeight() > weight){
+                            // shorter way: move it in the open list (or add it)
+                            auto openIte = getIte(_openList, vertexInGraph);
+                            if(openIte != _openList.end()){
+                                _openList.erase(openIte);
+                            }
+                            insertIntoOpenList(vertexInGraph, weight);
                             vertexInGraph->setWeight(weight);
                             vertexInGraph->setParent(startInGraph);
                         }
                     }
                 }
                 
+                if(_openList.empty()){
+                    // goal can not be reached
+#if DEBUG_PRINT
+                    CCLOG("*** PATH SEARCH END : no path");
+#endif
+                    return nullptr;
+                }
                 startInGraph = _openList.front();
                 _openList.erase(_openList.begin());
             }
             
-            while(_openList.size() != 0 && !startInGraph->getPosition().equals(toCoord));
-            
 #if DEBUG_PRINT
             CCLOG("*** PATH SEARCH END :");
-#endif
-            
-            auto to = *getIte(_graph, toCoord);
-#if DEBUG_PRINT
             CCLOG("start dump path: dijksra");
-#endif
-            while (to->getParent() != nullptr) {
-#if DEBUG_PRINT
+            for (auto to = startInGraph; to != nullptr; to = to->getParent()) {
                 CCLOG("%.0f %.0f", to->getPosition().x, to->getPosition().y);
-#endif
-                result.insert(result.begin(), to->getPosition());
-                to = to->getParent();
             }
-            //begin pos
-#if DEBUG_PRINT
-            CCLOG("%.0f %.0f", to->getPosition().x, to->getPosition().y);
-#endif
-            result.push_back(to->getPosition());
-#if DEBUG_PRINT
             CCLOG("end dump path");
 #endif
-            for (auto ite = _graph.begin(); ite != _graph.end(); ite ++) {
-                delete *ite;
+            
+            // the graph is kept for the next query, updateGraph rebuild it after a change of the map
+            return startInGraph;
+        }
+            
+        bool PathFinding::computeShortestPathTree(const cocos2d::Vec2 &fromCoord,
+                                                  const std::vector<cocos2d::Vec2> &targets,
+                                                  ShortestPathTree &tree)
+        {
+            int width = _map->getWidth();
+            int height = _map->getHeight();
+            size_t total = (size_t)width * height;
+            
+            tree._source = fromCoord;
+            tree._width = width;
+            tree._height = height;
+            tree._distances.assign(total, FLT_MAX);
+            tree._parents.assign(total, -1);
+            tree._settled.assign(total, false);
+            
+            if(!isValidCoord(fromCoord) || !canMoveAtCoord(fromCoord)){
+                return false;
+            }
+            
+            // targets still waiting to be settled, 0 means run to completion
+            // a blocked target is never settled, it would make the search cover the whole map
+            size_t remaining = 0;
+            std::vector<bool> isTarget;
+            if(!targets.empty()){
+                isTarget.assign(total, false);
+                for (auto& t : targets) {
+                    if(isValidCoord(t) && canMoveAtCoord(t) && !isTarget[tree.getIndex(t)]){
+                        isTarget[tree.getIndex(t)] = true;
+                        remaining ++;
+                    }
+                }
+                if(remaining == 0){
+                    return true;
+                }
             }
-            _graph.clear();
             
+            typedef std::pair<float, int32_t> QueueItem;
+            std::priority_queue<QueueItem, std::vector<QueueItem>, std::greater<QueueItem> > openList;
+            
+            int32_t start = tree.getIndex(fromCoord);
+            tree._distances[start] = 0;
+            openList.push(QueueItem(0, start));
+            
+            while (!openList.empty()) {
+                QueueItem item = openList.top();
+                openList.pop();
+                int32_t idx = item.second;
+                if(tree._settled[idx]){
+                    continue;
+                }
+                tree._settled[idx] = true;
+                
+                if(!isTarget.empty() && isTarget[idx] && --remaining == 0){
+                    break;
+                }
+                
+                Vec2 position(idx % width, idx / width);
+                auto nearbyVertex = getNearbyTileCoord(position);
+                for (auto ite = nearbyVertex.begin(); ite != nearbyVertex.end(); ite ++) {
+                    int32_t next = tree.getIndex(*ite);
+                    float weight = item.first + (position - *ite).length();
+                    if(!tree._settled[next] && weight < tree._distances[next]){
+                        tree._distances[next] = weight;
+                        tree._parents[next] = idx;
+                        openList.push(QueueItem(weight, next));
+                    }
+                }
+            }
+            
+            return true;
+        }
+        
+        float ShortestPathTree::distanceTo(const cocos2d::Vec2 &tile) const
+        {
+            if(!isSettled(tile)){
+                return FLT_MAX;
+            }
+            return _distances[getIndex(tile)];
+        }
+        
+        bool ShortestPathTree::isSettled(const cocos2d::Vec2 &tile) const
+        {
+            if(tile.x < 0 || tile.y < 0 || tile.x >= _width || tile.y >= _height){
+                return false;
+            }
+            return _settled[getIndex(tile)];
+        }
+        
+        std::vector<Vec2> ShortestPathTree::pathTo(const cocos2d::Vec2 &tile) const
+        {
+            std::vector<Vec2> result;
+            if(!isSettled(tile) || tile.equals(_source)){
+                return result;
+            }
+            for (int32_t idx = getIndex(tile); idx >= 0; idx = _parents[idx]) {
+                result.push_back(Vec2(idx % _width, idx / _width));
+            }
+            std::reverse(result.begin(), result.end());
             return result;
         }
+        
+        bool ShortestPathTree::pathTo(const cocos2d::Vec2 &tile, PathBuffer &result) const
+        {
+            result.beginReverse();
+            if(isSettled(tile) && !tile.equals(_source)){
+                for (int32_t idx = getIndex(tile); idx >= 0; idx = _parents[idx]) {
+                    result.pushReverse(idx % _width, idx / _width);
+                }
+            }
+            result.endReverse();
+            return !result.empty();
+        }
+        
+        bool PathFinding::findPathBidirectional(const cocos2d::Vec2 &fromCoord,
+                                                const cocos2d::Vec2 &toCoord,
+                                                std::vector<cocos2d::Vec2> &path)
+        {
+#if DEBUG_PRINT
+            CCLOG("*** PATH SEARCH BEGIN : bidirectional dijkstra");
+#endif
+            path.clear();
+            _stats = SearchStats();
+            
+            // Check that there is a path to compute ;-)
+            if(fromCoord.equals(toCoord)){
+                return false;
+            }
+            
+            if(!isValidCoord(fromCoord) || !canMoveAtCoord(fromCoord)){
+                return false;
+            }
+            
+            if(!isValidCoord(toCoord) || !canMoveAtCoord(toCoord)){
+                return false;
+            }
+            
+            // the moves of the engine seen by the generic search
+            struct Graph {
+                PathFinding* _engine;
+                
+                std::vector<Vec2> getNeighbours(const Vec2& tile){
+                    return _engine->getNearbyTileCoord(tile);
+                }
+                double getCost(const Vec2& from, const Vec2& to){
+                    return (from - to).length();
+                }
+                double getHeuristic(const Vec2& from, const Vec2& to){
+                    return 0;
+                }
+                bool isCancelled(){
+                    return _engine->_cancelCheck && _engine->_cancelCheck();
+                }
+                bool hasHeuristic(){
+                    return false;
+                }
+            };
+            
+            Graph graph = {this};
+            bool found = pathfinding::findPathBidirectional(graph, _bidirectionalTables, _map->getWidth(), _map->getHeight(),
+                                                            fromCoord, toCoord, path, _stats);
+#if DEBUG_PRINT
+            CCLOG("*** PATH SEARCH END : %d forward, %d backward expansions", _stats.forwardExpansions, _stats.backwardExpansions);
+#endif
+            return found;
+        }
     }
-}
\ No newline at end of file
+}
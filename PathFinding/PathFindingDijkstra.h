@@ -27,6 +27,12 @@
 
 #include "cocos2d.h"
 #include "CollisionData.h"
+#include "ClearanceMap.h"
+#include "CollisionOverlay.h"
+#include "PathBuffer.h"
+#include "PathFindingBidirectional.h"
+#include "PathFindingNearest.h"
+#include "PathTrace.h"
 
 namespace pathfinding {
     namespace dijkstra {
@@ -54,6 +60,47 @@ namespace pathfinding {
             
         };
         
+        /**
+         *  Result of one Dijkstra run from a source: distance and parent of every settled tile.
+         *  Keep it to answer many destinations without searching again.
+         */
+        class ShortestPathTree {
+            
+        public:
+            ShortestPathTree() :
+            _width(0),
+            _height(0)
+            {}
+            
+            /**
+             *  @return the path length, FLT_MAX if the tile was not settled (unreachable or search stopped before)
+             */
+            float distanceTo(const cocos2d::Vec2& tile) const;
+            
+            /**
+             *  same result as PathFinding::getShortestPath from the source
+             */
+            std::vector<cocos2d::Vec2> pathTo(const cocos2d::Vec2& tile) const;
+            bool pathTo(const cocos2d::Vec2& tile, PathBuffer& result) const;
+            
+            bool isSettled(const cocos2d::Vec2& tile) const;
+            
+            CC_SYNTHESIZE_READONLY_PASS_BY_REF(cocos2d::Vec2, _source, Source);
+            
+        protected:
+            friend class PathFinding;
+            
+            int _width;
+            int _height;
+            std::vector<float> _distances;
+            std::vector<int32_t> _parents;
+            std::vector<bool> _settled;
+            
+            inline int32_t getIndex(const cocos2d::Vec2& tile) const {
+                return (int32_t)tile.x + (int32_t)tile.y * _width;
+            }
+        };
+        
         class PathFinding : public cocos2d::Ref {
             
         public:
@@ -67,12 +114,105 @@ namespace pathfinding {
             
             std::vector<cocos2d::Vec2> getShortestPath(const cocos2d::Vec2& fromCoord,
                                                        const cocos2d::Vec2& toCoord);
+            
+            /**
+             *  same search, the path is written into a reusable compact buffer
+             *  @return true if a path was found
+             */
+            bool getShortestPath(const cocos2d::Vec2& fromCoord,
+                                 const cocos2d::Vec2& toCoord,
+                                 PathBuffer& result);
+            
+            /**
+             *  same search, but when the goal is a wall or can't be reached the path go to the
+             *  walkable tile nearest to it which is in the region of the start
+             *  the regions come from the map only, the overlays are not used to pick the goal
+             *  @param resolvedGoal if not null receive the tile used as goal
+             */
+            std::vector<cocos2d::Vec2> getShortestPathToNearest(const cocos2d::Vec2& fromCoord,
+                                                                const cocos2d::Vec2& toCoord,
+                                                                cocos2d::Vec2* resolvedGoal = nullptr);
+            bool getShortestPathToNearest(const cocos2d::Vec2& fromCoord,
+                                          const cocos2d::Vec2& toCoord,
+                                          PathBuffer& result,
+                                          cocos2d::Vec2* resolvedGoal = nullptr);
+            
+            /**
+             *  one Dijkstra from fromCoord, stop when all targets are settled
+             *  or explore the whole reachable map when targets is empty
+             *  the tree can be reused between calls to avoid allocation
+             *  @return false if fromCoord is not walkable
+             */
+            bool computeShortestPathTree(const cocos2d::Vec2& fromCoord,
+                                         const std::vector<cocos2d::Vec2>& targets,
+                                         ShortestPathTree& tree);
         protected:
             virtual bool init();
             virtual void generateGraph();
             
+            /**
+             *  generate the graph again if the map changed since it was generated (or never was)
+             */
+            void updateGraph();
+            void clearGraph();
+            
+            /**
+             *  run the search on the graph
+             *  @return the goal vertex, follow the parents to get the path, nullptr if no path
+             */
+            Vertex* findPath(const cocos2d::Vec2& fromCoord, const cocos2d::Vec2& toCoord);
+            
+            /**
+             *  run the bidirectional search
+             *  @return false if no path
+             */
+            bool findPathBidirectional(const cocos2d::Vec2& fromCoord, const cocos2d::Vec2& toCoord,
+                                       std::vector<cocos2d::Vec2>& path);
+            
             CC_SYNTHESIZE_READONLY(CollisionData *, _map, Map);
+            
+            /**
+             *  size in tiles of the agent, it cover [x, x + size) * [y, y + size) of its tile
+             *  bigger than 1 need CollisionData::enableClearanceMap, without it no path is found
+             */
+            CC_SYNTHESIZE(int, _agentSize, AgentSize);
+            
+            /**
+             *  getShortestPath search from both ends at once, same result with less
+             *  expansions on long queries. false by default
+             */
+            CC_SYNTHESIZE(bool, _bidirectional, Bidirectional);
+            
+            /**
+             *  work done by the last getShortestPath
+             */
+            CC_SYNTHESIZE_READONLY_PASS_BY_REF(SearchStats, _stats, Stats);
+            
+            /**
+             *  if set, called before every expansion, the search stop without path when it return true
+             *  (used to abandon the search of a job from another thread)
+             */
+            CC_SYNTHESIZE_PASS_BY_REF(std::function<bool()>, _cancelCheck, CancelCheck);
+            
+            /**
+             *  tiles blocked by these overlays can't be used, the map itself is not changed
+             *  they must have the size of the map, empty by default
+             */
+            CC_SYNTHESIZE_PASS_BY_REF(std::vector<CollisionOverlay *>, _overlays, Overlays);
+            
+            /**
+             *  if set, getShortestPath is recorded to it with the edits of the map (not retained)
+             *  the map is registered to it here and by setupMap, so the edits before the first query are recorded
+             */
+            CC_SYNTHESIZE_READONLY(trace::TraceRecorder *, _recorder, Recorder);
+            void setRecorder(trace::TraceRecorder* recorder);
+            
+            NearestTileResolver _nearest;
+            BidirectionalTables _bidirectionalTables;
             CC_SYNTHESIZE_READONLY(std::vector<Vertex *>, _graph, Graph);
+            std::vector<int32_t> _vertexIndexes;    // index in _graph of the vertex of each tile, -1 if none
+            unsigned int _graphVersion;             // map version the graph was generated from
+            bool _graphReady;
             CC_SYNTHESIZE_READONLY_PASS_BY_REF(std::vector<Vertex *>, _openList, OpenList);
             
             void insertIntoOpenList(Vertex *vertex, float weight);
@@ -98,6 +238,14 @@ namespace pathfinding {
                 return array.end();
             }
             
+            /**
+             *  @return the vertex of the tile, nullptr if it had a collision when the graph was generated
+             */
+            inline Vertex* getVertex(const cocos2d::Vec2& coord){
+                int32_t index = _vertexIndexes[(int)coord.x + (size_t)coord.y * _map->getWidth()];
+                return index < 0 ? nullptr : _graph[index];
+            }
+            
             inline bool contains(std::vector<Vertex *>& array, Vertex* step){
                 return getIte(array, step) != array.end();
             }
@@ -107,7 +255,14 @@ namespace pathfinding {
                         coord.y >= 0 && coord.y < _map->getHeight());
             }
             inline bool canMoveAtCoord(const cocos2d::Vec2& coord){
-                return !_map->haveCollisionAtCoord(coord.x, coord.y);
+                if(_agentSize > 1){
+                    // without the clearance map the fit of the agent is unknown, nothing is walkable
+                    const ClearanceMap* clearance = _map->getClearanceMap();
+                    return clearance && clearance->getClearance(coord.x, coord.y) >= _agentSize &&
+                    !CollisionOverlay::isRectBlocked(_overlays, coord.x, coord.y, _agentSize, _agentSize);
+                }
+                return !_map->haveCollisionAtCoord(coord.x, coord.y) &&
+                !CollisionOverlay::isBlocked(_overlays, coord.x, coord.y);
             }
         };
     }
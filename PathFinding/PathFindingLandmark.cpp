@@ -0,0 +1,328 @@
+/****************************************************************************
+ Copyright (c) 2015 QuanNguyen
+ 
+ http://quannguyen.info
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+
+#include "PathFindingLandmark.h"
+
+#include <thread>
+#include <atomic>
+#include <deque>
+
+USING_NS_CC;
+
+namespace pathfinding {
+    
+    namespace landmark {
+        
+        static const uint32_t kFileMagic = 0x31544C41; // "ALT1"
+        
+        /**
+         *  breadth first walk (4-connected, same moves as Astar::PathFinding)
+         *  write distance of tile i to out[i * stride], kUnreachable for other components
+         */
+        static void walkDistances(CollisionData* map, int startX, int startY, uint16_t* out, size_t stride)
+        {
+            int width = map->getWidth();
+            int height = map->getHeight();
+            ssize_t total = (ssize_t)width * height;
+            for (ssize_t i = 0; i < total; i ++) {
+                out[i * stride] = kUnreachable;
+            }
+            
+            std::deque<ssize_t> queue;
+            ssize_t start = startX + (ssize_t)startY * width;
+            out[start * stride] = 0;
+            queue.push_back(start);
+            
+            static const int dx[4] = {0, 0, -1, 1};
+            static const int dy[4] = {-1, 1, 0, 0};
+            
+            while (!queue.empty()) {
+                ssize_t pos = queue.front();
+                queue.pop_front();
+                
+                int x = pos % width;
+                int y = pos / width;
+                uint16_t d = out[pos * stride];
+                // clamp, a clamped distance is still a valid lower bound
+                uint16_t next = (d >= kUnreachable - 1) ? kUnreachable - 1 : d + 1;
+                
+                for (int i = 0; i < 4; i ++) {
+                    int nx = x + dx[i];
+                    int ny = y + dy[i];
+                    if(nx < 0 || ny < 0 || nx >= width || ny >= height){
+                        continue;
+                    }
+                    ssize_t npos = nx + (ssize_t)ny * width;
+                    if(out[npos * stride] != kUnreachable || map->haveCollisionAtCoord(nx, ny)){
+                        continue;
+                    }
+                    out[npos * stride] = next;
+                    queue.push_back(npos);
+                }
+            }
+        }
+        
+        bool LandmarkHeuristic::initWithMap(CollisionData *map, int numLandmarks)
+        {
+            CCASSERT(map, "Map must be not null");
+            CCASSERT(numLandmarks > 0, "Need at least one landmark");
+            
+            _map = map;
+            _width = map->getWidth();
+            _height = map->getHeight();
+            _landmarks.clear();
+            
+            ssize_t total = (ssize_t)_width * _height;
+            
+            // the walk start at any walkable tile, first landmark is the farthest tile from it
+            ssize_t seed = -1;
+            for (ssize_t i = 0; i < total && seed < 0; i ++) {
+                if(!_map->haveCollisionAtCoord(i % _width, i / _width)){
+                    seed = i;
+                }
+            }
+            if(seed < 0){
+                _distances.clear();
+                return false;
+            }
+            
+            std::vector<uint16_t> seedDistances(total);
+            walkDistances(_map, seed % _width, seed / _width, seedDistances.data(), 1);
+            
+            // min distance to all selected landmarks, unreached tiles stay at max so other components get covered
+            std::vector<uint32_t> minDistances(total, UINT32_MAX);
+            for (ssize_t i = 0; i < total; i ++) {
+                if(seedDistances[i] == kUnreachable){
+                    minDistances[i] = 0;
+                }
+            }
+            
+            _distances.assign(total * numLandmarks, kUnreachable);
+            
+            for (int k = 0; k < numLandmarks; k ++) {
+                ssize_t best = -1;
+                uint32_t bestValue = 0;
+                for (ssize_t i = 0; i < total; i ++) {
+                    uint32_t v = (k == 0) ? (seedDistances[i] == kUnreachable ? 0 : seedDistances[i] + 1) : minDistances[i];
+                    if(v > bestValue && (k == 0 || !_map->haveCollisionAtCoord(i % _width, i / _width))){
+                        bestValue = v;
+                        best = i;
+                    }
+                }
+                if(k == 0){
+                    // from now on every walkable tile is a candidate
+                    for (ssize_t i = 0; i < total; i ++) {
+                        minDistances[i] = _map->haveCollisionAtCoord(i % _width, i / _width) ? 0 : UINT32_MAX;
+                    }
+                }
+                if(best < 0){
+                    // every walkable tile is already a landmark
+                    break;
+                }
+                
+                _landmarks.push_back(Vec2(best % _width, best / _width));
+                walkDistances(_map, best % _width, best / _width, _distances.data() + k, numLandmarks);
+                
+                for (ssize_t i = 0; i < total; i ++) {
+                    uint16_t d = _distances[i * numLandmarks + k];
+                    if(d != kUnreachable && d < minDistances[i]){
+                        minDistances[i] = d;
+                    }
+                }
+            }
+            
+            if((int)_landmarks.size() < numLandmarks){
+                // tiny map, pack the tables again with the real landmark count
+                size_t count = _landmarks.size();
+                for (ssize_t i = 0; i < total; i ++) {
+                    for (size_t k = 0; k < count; k ++) {
+                        _distances[i * count + k] = _distances[i * numLandmarks + k];
+                    }
+                }
+                _distances.resize(total * count);
+            }
+            
+            _version = _map->getVersion();
+            CCLOG("LandmarkHeuristic: %d landmarks, %ld bytes", (int)_landmarks.size(), (long)(_distances.size() * sizeof(uint16_t)));
+            
+            return true;
+        }
+        
+        bool LandmarkHeuristic::initWithLandmarks(CollisionData *map, const std::vector<cocos2d::Vec2> &landmarks, int numThreads)
+        {
+            CCASSERT(map, "Map must be not null");
+            
+            _map = map;
+            _width = map->getWidth();
+            _height = map->getHeight();
+            _landmarks.clear();
+            
+            for (auto& v : landmarks) {
+                if(v.x < 0 || v.y < 0 || v.x >= _width || v.y >= _height || _map->haveCollisionAtCoord(v.x, v.y)){
+                    CCLOG("LandmarkHeuristic: skip landmark at %.0f %.0f", v.x, v.y);
+                    continue;
+                }
+                _landmarks.push_back(v);
+            }
+            
+            if(_landmarks.empty()){
+                _distances.clear();
+                return false;
+            }
+            
+            rebuild(numThreads);
+            return true;
+        }
+        
+        void LandmarkHeuristic::computeDistances(int landmarkIdx, std::vector<uint16_t>& distances)
+        {
+            const Vec2& l = _landmarks.at(landmarkIdx);
+            distances.resize((size_t)_width * _height);
+            walkDistances(_map, l.x, l.y, distances.data(), 1);
+        }
+        
+        void LandmarkHeuristic::rebuild(int numThreads)
+        {
+            size_t count = _landmarks.size();
+            ssize_t total = (ssize_t)_width * _height;
+            
+            if(numThreads <= 0){
+                numThreads = std::max(1u, std::thread::hardware_concurrency());
+            }
+            numThreads = std::min(numThreads, (int)count);
+            
+            // each job fill the contiguous table of its landmark: the threads never write the same cache line
+            std::vector<std::vector<uint16_t>> columns(count);
+            std::atomic<int> nextLandmark(0);
+            auto job = [this, &nextLandmark, &columns]() {
+                int idx;
+                while ((idx = nextLandmark++) < (int)_landmarks.size()) {
+                    computeDistances(idx, columns[idx]);
+                }
+            };
+            
+            std::vector<std::thread> threads;
+            for (int i = 1; i < numThreads; i ++) {
+                threads.push_back(std::thread(job));
+            }
+            job();
+            for (auto& t : threads) {
+                t.join();
+            }
+            
+            // then interleaved tile major for the lookups
+            _distances.resize(total * count);
+            for (size_t k = 0; k < count; k ++) {
+                const uint16_t* column = columns[k].data();
+                uint16_t* out = _distances.data() + k;
+                for (ssize_t i = 0; i < total; i ++) {
+                    out[i * count] = column[i];
+                }
+                std::vector<uint16_t>().swap(columns[k]);
+            }
+            _version = _map->getVersion();
+        }
+        
+        int LandmarkHeuristic::computeLowerBound(int fromX, int fromY, int toX, int toY) const
+        {
+            size_t count = _landmarks.size();
+            const uint16_t* from = &_distances[((ssize_t)fromX + (ssize_t)fromY * _width) * count];
+            const uint16_t* to = &_distances[((ssize_t)toX + (ssize_t)toY * _width) * count];
+            
+            int best = 0;
+            for (size_t k = 0; k < count; k ++) {
+                if(from[k] == kUnreachable || to[k] == kUnreachable){
+                    continue;
+                }
+                int d = std::abs((int)to[k] - (int)from[k]);
+                if(d > best){
+                    best = d;
+                }
+            }
+            return best;
+        }
+        
+        bool LandmarkHeuristic::saveToFile(const std::string &fileName) const
+        {
+            FILE* fp = fopen(fileName.c_str(), "wb");
+            if(!fp){
+                return false;
+            }
+            
+            uint32_t header[5] = {kFileMagic, (uint32_t)_width, (uint32_t)_height, (uint32_t)_landmarks.size(), _map->computeChecksum()};
+            bool ok = fwrite(header, sizeof(header), 1, fp) == 1;
+            for (auto& v : _landmarks) {
+                int32_t coord[2] = {(int32_t)v.x, (int32_t)v.y};
+                ok = ok && fwrite(coord, sizeof(coord), 1, fp) == 1;
+            }
+            ok = ok && fwrite(_distances.data(), sizeof(uint16_t), _distances.size(), fp) == _distances.size();
+            fclose(fp);
+            
+            return ok;
+        }
+        
+        bool LandmarkHeuristic::initWithFile(CollisionData *map, const std::string &fileName)
+        {
+            CCASSERT(map, "Map must be not null");
+            
+            FILE* fp = fopen(fileName.c_str(), "rb");
+            if(!fp){
+                return false;
+            }
+            
+            _map = map;
+            _width = map->getWidth();
+            _height = map->getHeight();
+            _landmarks.clear();
+            _distances.clear();
+            
+            uint32_t header[5];
+            bool ok = fread(header, sizeof(header), 1, fp) == 1
+                && header[0] == kFileMagic
+                && header[1] == (uint32_t)_width
+                && header[2] == (uint32_t)_height
+                && header[4] == _map->computeChecksum();
+            
+            for (uint32_t k = 0; ok && k < header[3]; k ++) {
+                int32_t coord[2];
+                ok = fread(coord, sizeof(coord), 1, fp) == 1;
+                _landmarks.push_back(Vec2(coord[0], coord[1]));
+            }
+            
+            if(ok){
+                _distances.resize((ssize_t)_width * _height * _landmarks.size());
+                ok = fread(_distances.data(), sizeof(uint16_t), _distances.size(), fp) == _distances.size();
+            }
+            fclose(fp);
+            
+            if(!ok){
+                CCLOG("LandmarkHeuristic: %s does not match the map", fileName.c_str());
+                _landmarks.clear();
+                _distances.clear();
+            }
+            _version = _map->getVersion();
+            return ok;
+        }
+    }
+}
@@ -0,0 +1,139 @@
+/****************************************************************************
+ Copyright (c) 2015 QuanNguyen
+ 
+ http://quannguyen.info
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+
+#ifndef __Funny_PathFinding__Landmark__
+#define __Funny_PathFinding__Landmark__
+
+#include "cocos2d.h"
+#include "CollisionData.h"
+
+namespace pathfinding {
+    
+    namespace landmark {
+        
+        /**
+         *  Distance stored for a tile which can not be reached from a landmark
+         */
+        static const uint16_t kUnreachable = 0xFFFF;
+        
+        /**
+         *  ALT (A*, Landmarks, Triangle inequality) heuristic.
+         *
+         *  K landmarks are picked with farthest-point selection and for every tile we keep
+         *  the 4-connected walking distance to each landmark (16 bit per landmark).
+         *  For any landmark L: |d(L, goal) - d(L, tile)| <= d(tile, goal), so the max over
+         *  all landmarks is an admissible and consistent heuristic for Astar::PathFinding.
+         *
+         *  Memory / accuracy trade-off: the tables cost 2 * K bytes per tile,
+         *  more landmarks give a tighter bound (8 - 16 is usually enough for maze maps).
+         *  Distances are clamped to 65534, clamping only make the bound weaker, never wrong.
+         */
+        class LandmarkHeuristic
+        {
+        public:
+            LandmarkHeuristic() :
+            _map(nullptr),
+            _width(0),
+            _height(0),
+            _version(0)
+            {
+            };
+            
+            virtual ~LandmarkHeuristic()
+            {
+            }
+            
+            /**
+             *  pick numLandmarks landmarks with farthest-point selection and build the tables
+             *  @return true if build successful
+             */
+            bool initWithMap(CollisionData* map, int numLandmarks);
+            
+            /**
+             *  build the tables for known landmarks (hand placed or loaded), one landmark per thread job
+             *  @param numThreads 0 will use the hardware concurrency
+             *  @return true if build successful
+             */
+            bool initWithLandmarks(CollisionData* map, const std::vector<cocos2d::Vec2>& landmarks, int numThreads = 0);
+            
+            /**
+             *  load tables saved with saveToFile, the map must be the one used to build them
+             *  @return true if load successful
+             */
+            bool initWithFile(CollisionData* map, const std::string& fileName);
+            
+            /**
+             *  save the tables, usually next to the map image (ex: "map.png.alt")
+             *  @return true if save successful
+             */
+            bool saveToFile(const std::string& fileName) const;
+            
+            /**
+             *  recompute all tables after the map changed
+             */
+            void rebuild(int numThreads = 0);
+            
+            /**
+             *  @return false if the map changed since the tables were built, removed walls make them overestimate
+             */
+            inline bool isUpToDate() const {
+                return _map && _version == _map->getVersion();
+            }
+            
+            /**
+             *  lower bound of the walking distance between 2 tiles
+             */
+            int computeLowerBound(int fromX, int fromY, int toX, int toY) const;
+            
+            inline int getLandmarkCount() const {
+                return (int)_landmarks.size();
+            }
+            
+            /**
+             *  @return the distance from a landmark to a tile, kUnreachable if can not reach
+             */
+            inline uint16_t getDistance(int landmarkIdx, int x, int y) const {
+                return _distances[((ssize_t)x + (ssize_t)y * _width) * _landmarks.size() + landmarkIdx];
+            }
+            
+        protected:
+            // tile major: the K distances of a tile are contiguous so one lookup is one cache line
+            std::vector<uint16_t> _distances;
+            
+            void computeDistances(int landmarkIdx, std::vector<uint16_t>& distances);
+            
+            CC_SYNTHESIZE_READONLY(CollisionData *, _map, Map);
+            CC_SYNTHESIZE_READONLY(int, _width, Width);
+            CC_SYNTHESIZE_READONLY(int, _height, Height);
+            
+            /**
+             *  version of the map when the tables were built
+             */
+            CC_SYNTHESIZE_READONLY(unsigned int, _version, Version);
+            CC_SYNTHESIZE_READONLY_PASS_BY_REF(std::vector<cocos2d::Vec2>, _landmarks, Landmarks);
+        };
+    }
+}
+
+#endif /* defined(__Funny_PathFinding__Landmark__) */
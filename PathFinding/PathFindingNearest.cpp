@@ -0,0 +1,194 @@
+/****************************************************************************
+ Copyright (c) 2015 QuanNguyen
+ 
+ http://quannguyen.info
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+
+#include "PathFindingNearest.h"
+#include "BitUtils.h"
+
+USING_NS_CC;
+
+namespace pathfinding {
+    
+    const int NearestTileResolver::kNoRegion;
+    
+    void NearestTileResolver::setupMap(const CollisionData *map)
+    {
+        CCASSERT(map, "Map must be not null");
+        _map = map;
+        _regions.clear();
+        _agentSize = 0;
+    }
+    
+    void NearestTileResolver::computeRegions(int agentSize)
+    {
+        int width = _map->getWidth();
+        int height = _map->getHeight();
+        
+        _regions.assign((size_t)width * height, kNoRegion);
+        _version = _map->getVersion();
+        _agentSize = agentSize;
+        _clearance = _map->getClearanceMap();
+        
+        std::vector<size_t> stack;
+        int region = 0;
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                size_t idx = x + (size_t)y * width;
+                if(_regions[idx] != kNoRegion || !isWalkable(x, y, agentSize)){
+                    continue;
+                }
+                
+                // flood fill the new region
+                _regions[idx] = region;
+                stack.push_back(idx);
+                while (!stack.empty()) {
+                    size_t cur = stack.back();
+                    stack.pop_back();
+                    int cx = cur % width;
+                    int cy = cur / width;
+                    
+                    static const int dx[] = {0, 0, -1, 1};
+                    static const int dy[] = {-1, 1, 0, 0};
+                    for (int i = 0; i < 4; i++) {
+                        int nx = cx + dx[i];
+                        int ny = cy + dy[i];
+                        if(nx < 0 || ny < 0 || nx >= width || ny >= height){
+                            continue;
+                        }
+                        size_t nIdx = nx + (size_t)ny * width;
+                        if(_regions[nIdx] == kNoRegion && isWalkable(nx, ny, agentSize)){
+                            _regions[nIdx] = region;
+                            stack.push_back(nIdx);
+                        }
+                    }
+                }
+                region ++;
+            }
+        }
+    }
+    
+    int NearestTileResolver::getRegion(int x, int y, int agentSize)
+    {
+        CCASSERT(_map, "Map must be setup");
+        if(_regions.empty() || _version != _map->getVersion() || _agentSize != agentSize ||
+           (agentSize > 1 && _clearance != _map->getClearanceMap())){
+            computeRegions(agentSize);
+        }
+        return regionAt(x, y);
+    }
+    
+    void NearestTileResolver::scanRow(int y, int x0, int x1, int region, int gx, int gy,
+                                      int64_t &bestDist, int &bestX, int &bestY) const
+    {
+        if(y < 0 || y >= (int)_map->getHeight()){
+            return;
+        }
+        x0 = std::max(x0, 0);
+        x1 = std::min(x1, (int)_map->getWidth() - 1);
+        
+        ssize_t rowPos = (ssize_t)y * _map->getWidth();
+        int64_t dy = y - gy;
+        for (int x = x0; x <= x1; x += CollisionData::kMaskBits) {
+            // bit set = no collision, drop the tiles after x1
+            MaskType bits = _map->readBits(rowPos + x);
+            int n = std::min(CollisionData::kMaskBits, x1 - x + 1);
+            if(n < CollisionData::kMaskBits){
+                bits &= ~(MaskType)0 << (CollisionData::kMaskBits - n);
+            }
+            
+            while (bits) {
+                int lz = countLeadingZeros64(bits) - (64 - CollisionData::kMaskBits);
+                bits &= ~((MaskType)1 << (CollisionData::kMaskBits - 1 - lz));
+                
+                int tx = x + lz;
+                if(regionAt(tx, y) != region){
+                    continue;
+                }
+                int64_t dx = tx - gx;
+                int64_t dist = dx * dx + dy * dy;
+                if(dist < bestDist){
+                    bestDist = dist;
+                    bestX = tx;
+                    bestY = y;
+                }
+            }
+        }
+    }
+    
+    bool NearestTileResolver::resolve(const cocos2d::Vec2 &fromCoord, const cocos2d::Vec2 &toCoord,
+                                      int agentSize, cocos2d::Vec2 &result)
+    {
+        int region = getRegion(fromCoord.x, fromCoord.y, agentSize);
+        if(region == kNoRegion){
+            result = fromCoord;
+            return false;
+        }
+        
+        int gx = toCoord.x;
+        int gy = toCoord.y;
+        if(regionAt(gx, gy) == region){
+            result = toCoord;
+            return true;
+        }
+        
+        // the start is always a candidate so the search is bounded by its distance
+        int bestX = fromCoord.x;
+        int bestY = fromCoord.y;
+        int64_t bestDist = (int64_t)(bestX - gx) * (bestX - gx) + (int64_t)(bestY - gy) * (bestY - gy);
+        
+        int width = _map->getWidth();
+        int height = _map->getHeight();
+        
+        // every tile of ring r is at least r away, stop once r * r can't beat the best
+        for (int r = 1; (int64_t)r * r < bestDist; r++) {
+            if(gx - r < 0 && gy - r < 0 && gx + r >= width && gy + r >= height){
+                break;
+            }
+            
+            scanRow(gy - r, gx - r, gx + r, region, gx, gy, bestDist, bestX, bestY);
+            scanRow(gy + r, gx - r, gx + r, region, gx, gy, bestDist, bestX, bestY);
+            
+            // the left and right columns, one tile per row
+            for (int y = std::max(gy - r + 1, 0); y <= std::min(gy + r - 1, height - 1); y++) {
+                int64_t dy = y - gy;
+                int64_t dist = (int64_t)r * r + dy * dy;
+                if(dist >= bestDist){
+                    continue;
+                }
+                if(regionAt(gx - r, y) == region){
+                    bestDist = dist;
+                    bestX = gx - r;
+                    bestY = y;
+                }
+                else if(regionAt(gx + r, y) == region){
+                    bestDist = dist;
+                    bestX = gx + r;
+                    bestY = y;
+                }
+            }
+        }
+        
+        result = Vec2(bestX, bestY);
+        return true;
+    }
+}
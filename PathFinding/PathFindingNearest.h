@@ -0,0 +1,100 @@
+/****************************************************************************
+ Copyright (c) 2015 QuanNguyen
+ 
+ http://quannguyen.info
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+
+#ifndef __Funny_PathFinding__Nearest__
+#define __Funny_PathFinding__Nearest__
+
+#include "cocos2d.h"
+#include "CollisionData.h"
+#include "ClearanceMap.h"
+
+namespace pathfinding {
+    
+    /**
+     *  Find the walkable tile nearest to a goal which can be reached from a start.
+     *
+     *  The connected regions of the map are labelled once (4 connected, same regions as
+     *  8 connected without corner cutting) and labelled again only when the map version or
+     *  the agent size change. The goal is then resolved with rings of growing radius around
+     *  it, the rows of a ring are scanned kMaskBits tiles at a time and walls are skipped
+     *  with count leading zeros.
+     */
+    class NearestTileResolver {
+        
+    public:
+        static const int kNoRegion = -1;
+        
+        NearestTileResolver() :
+        _map(nullptr),
+        _version(0),
+        _agentSize(0),
+        _clearance(nullptr)
+        {
+        };
+        
+        void setupMap(const CollisionData* map);
+        
+        /**
+         *  @param result the goal itself if it can be reached, else the reachable tile
+         *  with the lowest euclidean distance to it (the start if nothing is closer)
+         *  @return false if the start tile is not walkable
+         */
+        bool resolve(const cocos2d::Vec2& fromCoord, const cocos2d::Vec2& toCoord,
+                     int agentSize, cocos2d::Vec2& result);
+        
+        /**
+         *  region label of a tile, kNoRegion for walls and tiles outside of the map
+         */
+        int getRegion(int x, int y, int agentSize);
+        
+    protected:
+        void computeRegions(int agentSize);
+        void scanRow(int y, int x0, int x1, int region, int gx, int gy,
+                     int64_t& bestDist, int& bestX, int& bestY) const;
+        
+        inline bool isWalkable(int x, int y, int agentSize) const {
+            if(agentSize > 1){
+                // like the engines: without the clearance map nothing is walkable
+                const ClearanceMap* clearance = _map->getClearanceMap();
+                return clearance && clearance->getClearance(x, y) >= agentSize;
+            }
+            return !_map->haveCollisionAtCoord(x, y);
+        }
+        
+        inline int regionAt(int x, int y) const {
+            if(x < 0 || y < 0 || x >= (int)_map->getWidth() || y >= (int)_map->getHeight()){
+                return kNoRegion;
+            }
+            return _regions[x + (size_t)y * _map->getWidth()];
+        }
+        
+        const CollisionData* _map;
+        std::vector<int> _regions;
+        unsigned int _version;
+        int _agentSize;
+        const ClearanceMap* _clearance;     // clearance map of the regions, they change when it is enabled
+    };
+}
+
+#endif /* defined(__Funny_PathFinding__Nearest__) */
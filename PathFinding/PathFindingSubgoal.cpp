@@ -0,0 +1,579 @@
+/****************************************************************************
+ Copyright (c) 2015 QuanNguyen
+ 
+ http://quannguyen.info
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+
+#include "PathFindingSubgoal.h"
+
+#include <queue>
+
+USING_NS_CC;
+
+namespace pathfinding {
+    
+    namespace subgoal {
+        
+        // octile paths only use the cardinal move (cx, cy) and the diagonal move (cx + px, cy + py)
+        static const int kOctants[8][4] = {
+            {1, 0, 0, 1}, {1, 0, 0, -1}, {-1, 0, 0, 1}, {-1, 0, 0, -1},
+            {0, 1, 1, 0}, {0, 1, -1, 0}, {0, -1, 1, 0}, {0, -1, -1, 0}
+        };
+        
+        static const int kWitnessSettleLimit = 1000;
+        
+        typedef std::pair<float, int32_t> QueueItem;
+        typedef std::priority_queue<QueueItem, std::vector<QueueItem>, std::greater<QueueItem> > Queue;
+        
+        PathFinding::PathFinding() :
+        _map(nullptr),
+        _contracted(false)
+        {
+            
+        }
+        
+        PathFinding::~PathFinding()
+        {
+            
+        }
+        
+        bool PathFinding::init()
+        {
+            return true;
+        }
+        
+        void PathFinding::setupMap(CollisionData *map, bool contract)
+        {
+            CCASSERT(map, "Map must be not null");
+            _map = map;
+            _contracted = false;
+            _upward.clear();
+            _order.clear();
+            
+            generateGraph();
+            if(contract){
+                contractGraph();
+            }
+        }
+        
+        int PathFinding::getEdgeCount() const
+        {
+            size_t count = 0;
+            for (auto& edges : _edges) {
+                count += edges.size();
+            }
+            return (int)(count / 2);
+        }
+        
+        void PathFinding::generateGraph()
+        {
+            int width = _map->getWidth();
+            int height = _map->getHeight();
+            
+            _ids.assign((size_t)width * height, -1);
+            _subgoals.clear();
+            
+            // a subgoal is a free tile next to a convex corner: a blocked diagonal we can walk around
+            for (int y = 0; y < height; y ++) {
+                for (int x = 0; x < width; x ++) {
+                    if(!isFree(x, y)){
+                        continue;
+                    }
+                    for (int dx = -1; dx <= 1; dx += 2) {
+                        for (int dy = -1; dy <= 1; dy += 2) {
+                            if(_ids[x + (ssize_t)y * width] < 0
+                               && isFree(x + dx, y) && isFree(x, y + dy) && !isFree(x + dx, y + dy)){
+                                _ids[x + (ssize_t)y * width] = (int32_t)_subgoals.size();
+                                _subgoals.push_back(x + (ssize_t)y * width);
+                            }
+                        }
+                    }
+                }
+            }
+            
+            _edges.assign(_subgoals.size(), std::vector<Edge>());
+            std::vector<int32_t> reachable;
+            for (int32_t i = 0; i < (int32_t)_subgoals.size(); i ++) {
+                ssize_t tile = _subgoals[i];
+                findDirectHReachable(tile % width, tile / width, reachable);
+                for (int32_t j : reachable) {
+                    if(j != i){
+                        Edge e = {j, computeOctile(tile, _subgoals[j]), -1};
+                        _edges[i].push_back(e);
+                    }
+                }
+            }
+            
+            CCLOG("Subgoal graph: %d subgoals, %d edges", getSubgoalCount(), getEdgeCount());
+        }
+        
+        void PathFinding::findDirectHReachable(int x, int y, std::vector<int32_t> &result)
+        {
+            int width = _map->getWidth();
+            result.clear();
+            
+            // 0: not reached, 1: reached, 2: reached a subgoal, stop there
+            std::vector<char> prev, cur;
+            for (int o = 0; o < 8; o ++) {
+                int cx = kOctants[o][0], cy = kOctants[o][1];
+                int px = kOctants[o][2], py = kOctants[o][3];
+                
+                prev.assign(1, 1);
+                for (int i = 1; ; i ++) {
+                    cur.assign(i + 1, 0);
+                    bool propagate = false;
+                    for (int j = 0; j <= i; j ++) {
+                        int tx = x + i * cx + j * px;
+                        int ty = y + i * cy + j * py;
+                        if(!isFree(tx, ty)){
+                            continue;
+                        }
+                        
+                        // straight from (i - 1, j) or diagonal from (i - 1, j - 1) without corner cutting
+                        bool reached = (j < i && prev[j] == 1);
+                        if(!reached && j > 0 && prev[j - 1] == 1){
+                            reached = isFree(tx - px, ty - py) && isFree(tx - cx, ty - cy);
+                        }
+                        if(!reached){
+                            continue;
+                        }
+                        
+                        int32_t id = _ids[tx + (ssize_t)ty * width];
+                        if(id >= 0){
+                            result.push_back(id);
+                            cur[j] = 2;
+                        }else{
+                            cur[j] = 1;
+                            propagate = true;
+                        }
+                    }
+                    if(!propagate){
+                        break;
+                    }
+                    prev.swap(cur);
+                }
+            }
+            
+            // the cardinal and diagonal lines are shared by 2 octants
+            std::sort(result.begin(), result.end());
+            result.erase(std::unique(result.begin(), result.end()), result.end());
+        }
+        
+        bool PathFinding::refineSegment(ssize_t fromTile, ssize_t toTile, std::vector<cocos2d::Vec2> &result)
+        {
+            int width = _map->getWidth();
+            int ax = fromTile % width, ay = fromTile / width;
+            int dx = (int)(toTile % width) - ax, dy = (int)(toTile / width) - ay;
+            
+            int cx, cy, px, py, major, minor;
+            if(std::abs(dx) >= std::abs(dy)){
+                cx = dx > 0 ? 1 : -1; cy = 0;
+                px = 0; py = dy >= 0 ? 1 : -1;
+                major = std::abs(dx); minor = std::abs(dy);
+            }else{
+                cx = 0; cy = dy > 0 ? 1 : -1;
+                px = dx >= 0 ? 1 : -1; py = 0;
+                major = std::abs(dy); minor = std::abs(dx);
+            }
+            if(major == 0){
+                return true;
+            }
+            
+            // 0: not reached, 1: straight move, 2: diagonal move, 3: start
+            int stride = minor + 1;
+            std::vector<uint8_t> moves((size_t)(major + 1) * stride, 0);
+            moves[0] = 3;
+            for (int i = 1; i <= major; i ++) {
+                for (int j = std::max(0, minor - (major - i)); j <= std::min(i, minor); j ++) {
+                    int tx = ax + i * cx + j * px;
+                    int ty = ay + i * cy + j * py;
+                    if(!isFree(tx, ty)){
+                        continue;
+                    }
+                    if(j < i && moves[(i - 1) * stride + j]){
+                        moves[i * stride + j] = 1;
+                    }else if(j > 0 && moves[(i - 1) * stride + j - 1]
+                             && isFree(tx - px, ty - py) && isFree(tx - cx, ty - cy)){
+                        moves[i * stride + j] = 2;
+                    }
+                }
+            }
+            if(!moves[major * stride + minor]){
+                return false;
+            }
+            
+            size_t begin = result.size();
+            for (int i = major, j = minor; i > 0; i --) {
+                result.push_back(Vec2(ax + i * cx + j * px, ay + i * cy + j * py));
+                if(moves[i * stride + j] == 2){
+                    j --;
+                }
+            }
+            std::reverse(result.begin() + begin, result.end());
+            return true;
+        }
+        
+        void PathFinding::contractGraph()
+        {
+            int32_t count = (int32_t)_subgoals.size();
+            std::vector<std::vector<Edge> > graph = _edges;
+            std::vector<char> contracted(count, 0);
+            _upward.assign(count, std::vector<Edge>());
+            _order.assign(count, -1);
+            
+            // witness search state, reset through the touched list
+            std::vector<float> dist(count, FLT_MAX);
+            std::vector<int32_t> touched;
+            
+            // @return number of shortcuts needed to contract v, add them when apply is true
+            auto contract = [&](int32_t v, bool apply) -> int {
+                int shortcuts = 0;
+                auto& edges = graph[v];
+                for (size_t a = 0; a < edges.size(); a ++) {
+                    float maxCost = 0;
+                    for (size_t b = a + 1; b < edges.size(); b ++) {
+                        maxCost = std::max(maxCost, edges[a].cost + edges[b].cost);
+                    }
+                    if(maxCost == 0){
+                        continue;
+                    }
+                    
+                    // bounded Dijkstra from u which can not use v
+                    int32_t u = edges[a].to;
+                    Queue queue;
+                    dist[u] = 0;
+                    touched.push_back(u);
+                    queue.push(QueueItem(0, u));
+                    int settled = 0;
+                    while (!queue.empty() && settled < kWitnessSettleLimit) {
+                        QueueItem item = queue.top();
+                        queue.pop();
+                        if(item.first > dist[item.second]){
+                            continue;
+                        }
+                        if(item.first > maxCost){
+                            break;
+                        }
+                        settled ++;
+                        for (auto& e : graph[item.second]) {
+                            float d = item.first + e.cost;
+                            if(e.to != v && d < dist[e.to]){
+                                if(dist[e.to] == FLT_MAX){
+                                    touched.push_back(e.to);
+                                }
+                                dist[e.to] = d;
+                                queue.push(QueueItem(d, e.to));
+                            }
+                        }
+                    }
+                    
+                    for (size_t b = a + 1; b < edges.size(); b ++) {
+                        int32_t w = edges[b].to;
+                        float cost = edges[a].cost + edges[b].cost;
+                        if(dist[w] <= cost + 1e-4f){
+                            continue;
+                        }
+                        shortcuts ++;
+                        if(!apply){
+                            continue;
+                        }
+                        // add or improve the shortcut in both direction
+                        for (int side = 0; side < 2; side ++) {
+                            int32_t from = side ? w : u;
+                            int32_t to = side ? u : w;
+                            bool found = false;
+                            for (auto& e : graph[from]) {
+                                if(e.to == to){
+                                    found = true;
+                                    if(cost < e.cost){
+                                        e.cost = cost;
+                                        e.via = v;
+                                    }
+                                }
+                            }
+                            if(!found){
+                                Edge e = {to, cost, v};
+                                graph[from].push_back(e);
+                            }
+                        }
+                    }
+                    
+                    for (int32_t t : touched) {
+                        dist[t] = FLT_MAX;
+                    }
+                    touched.clear();
+                }
+                return shortcuts;
+            };
+            
+            // lazy update of the edge difference
+            Queue queue;
+            for (int32_t v = 0; v < count; v ++) {
+                queue.push(QueueItem((float)(contract(v, false) - (int)graph[v].size()), v));
+            }
+            
+            int32_t rank = 0;
+            while (!queue.empty()) {
+                QueueItem item = queue.top();
+                queue.pop();
+                int32_t v = item.second;
+                if(contracted[v]){
+                    continue;
+                }
+                float priority = (float)(contract(v, false) - (int)graph[v].size());
+                if(!queue.empty() && priority > queue.top().first){
+                    queue.push(QueueItem(priority, v));
+                    continue;
+                }
+                
+                contract(v, true);
+                _order[v] = rank ++;
+                _upward[v] = graph[v];
+                contracted[v] = 1;
+                for (auto& e : graph[v]) {
+                    auto& back = graph[e.to];
+                    for (auto ite = back.begin(); ite != back.end(); ite ++) {
+                        if(ite->to == v){
+                            back.erase(ite);
+                            break;
+                        }
+                    }
+                }
+                graph[v].clear();
+            }
+            
+            _contracted = true;
+            
+            size_t upward = 0;
+            for (auto& edges : _upward) {
+                upward += edges.size();
+            }
+            CCLOG("Subgoal graph contracted: %ld upward edges", (long)upward);
+        }
+        
+        void PathFinding::unpackEdge(int32_t from, int32_t to, std::vector<int32_t> &result)
+        {
+            if(_contracted){
+                // the edge is stored in the upward list of the lower one
+                int32_t lower = _order[from] < _order[to] ? from : to;
+                int32_t upper = lower == from ? to : from;
+                for (auto& e : _upward[lower]) {
+                    if(e.to == upper && e.via >= 0){
+                        unpackEdge(from, e.via, result);
+                        unpackEdge(e.via, to, result);
+                        return;
+                    }
+                }
+            }
+            result.push_back(to);
+        }
+        
+        float PathFinding::searchGraph(const std::vector<Edge> &startEdges, const std::vector<Edge> &goalEdges,
+                                       ssize_t goalTile, std::vector<int32_t> &result)
+        {
+            // A* on the subgoal graph, the goal is the extra node at index count
+            int32_t count = (int32_t)_subgoals.size();
+            int32_t goal = count;
+            
+            std::vector<float> gScore(count + 1, FLT_MAX);
+            std::vector<float> goalCost(count, FLT_MAX);
+            std::vector<int32_t> parent(count + 1, -1);
+            std::vector<char> closed(count, 0);
+            
+            for (auto& e : goalEdges) {
+                goalCost[e.to] = e.cost;
+            }
+            
+            Queue queue;
+            for (auto& e : startEdges) {
+                gScore[e.to] = e.cost;
+                queue.push(QueueItem(e.cost + computeOctile(_subgoals[e.to], goalTile), e.to));
+            }
+            
+            while (!queue.empty()) {
+                QueueItem item = queue.top();
+                queue.pop();
+                int32_t u = item.second;
+                if(u == goal){
+                    break;
+                }
+                if(closed[u]){
+                    continue;
+                }
+                closed[u] = 1;
+                
+                if(goalCost[u] < FLT_MAX && gScore[u] + goalCost[u] < gScore[goal]){
+                    gScore[goal] = gScore[u] + goalCost[u];
+                    parent[goal] = u;
+                    queue.push(QueueItem(gScore[goal], goal));
+                }
+                
+                for (auto& e : _edges[u]) {
+                    float g = gScore[u] + e.cost;
+                    if(!closed[e.to] && g < gScore[e.to]){
+                        gScore[e.to] = g;
+                        parent[e.to] = u;
+                        queue.push(QueueItem(g + computeOctile(_subgoals[e.to], goalTile), e.to));
+                    }
+                }
+            }
+            
+            if(parent[goal] < 0){
+                return -1;
+            }
+            
+            result.clear();
+            for (int32_t v = parent[goal]; v >= 0; v = parent[v]) {
+                result.push_back(v);
+            }
+            std::reverse(result.begin(), result.end());
+            return gScore[goal];
+        }
+        
+        float PathFinding::searchUpward(const std::vector<Edge> &startEdges, const std::vector<Edge> &goalEdges,
+                                        std::vector<int32_t> &result)
+        {
+            // contraction hierarchy query: one upward Dijkstra from each side, meet at the best node
+            int32_t count = (int32_t)_subgoals.size();
+            std::vector<float> dist[2];
+            std::vector<int32_t> parent[2];
+            
+            for (int side = 0; side < 2; side ++) {
+                dist[side].assign(count, FLT_MAX);
+                parent[side].assign(count, -1);
+                
+                Queue queue;
+                for (auto& e : (side ? goalEdges : startEdges)) {
+                    if(e.cost < dist[side][e.to]){
+                        dist[side][e.to] = e.cost;
+                        queue.push(QueueItem(e.cost, e.to));
+                    }
+                }
+                while (!queue.empty()) {
+                    QueueItem item = queue.top();
+                    queue.pop();
+                    int32_t u = item.second;
+                    if(item.first > dist[side][u]){
+                        continue;
+                    }
+                    for (auto& e : _upward[u]) {
+                        float d = item.first + e.cost;
+                        if(d < dist[side][e.to]){
+                            dist[side][e.to] = d;
+                            parent[side][e.to] = u;
+                            queue.push(QueueItem(d, e.to));
+                        }
+                    }
+                }
+            }
+            
+            float best = FLT_MAX;
+            int32_t meet = -1;
+            for (int32_t v = 0; v < count; v ++) {
+                if(dist[0][v] < FLT_MAX && dist[1][v] < FLT_MAX && dist[0][v] + dist[1][v] < best){
+                    best = dist[0][v] + dist[1][v];
+                    meet = v;
+                }
+            }
+            if(meet < 0){
+                return -1;
+            }
+            
+            result.clear();
+            for (int32_t v = meet; v >= 0; v = parent[0][v]) {
+                result.push_back(v);
+            }
+            std::reverse(result.begin(), result.end());
+            for (int32_t v = parent[1][meet]; v >= 0; v = parent[1][v]) {
+                result.push_back(v);
+            }
+            return best;
+        }
+        
+        std::vector<Vec2> PathFinding::getShortestPath(const cocos2d::Vec2 &fromCoord, const cocos2d::Vec2 &toCoord)
+        {
+            std::vector<Vec2> result;
+            // Check that there is a path to compute ;-)
+            if(fromCoord.equals(toCoord)){
+                return result;
+            }
+            
+            if(!isFree(fromCoord.x, fromCoord.y) || !isFree(toCoord.x, toCoord.y)){
+                return result;
+            }
+            
+            int width = _map->getWidth();
+            ssize_t fromTile = (int)fromCoord.x + (ssize_t)fromCoord.y * width;
+            ssize_t toTile = (int)toCoord.x + (ssize_t)toCoord.y * width;
+            
+            // goal in octile reach, no need to search
+            result.push_back(fromCoord);
+            if(refineSegment(fromTile, toTile, result)){
+                return result;
+            }
+            
+            std::vector<Edge> startEdges, goalEdges;
+            std::vector<int32_t> reachable;
+            for (int side = 0; side < 2; side ++) {
+                ssize_t tile = side ? toTile : fromTile;
+                std::vector<Edge>& edges = side ? goalEdges : startEdges;
+                if(_ids[tile] >= 0){
+                    Edge e = {_ids[tile], 0, -1};
+                    edges.push_back(e);
+                    continue;
+                }
+                findDirectHReachable(tile % width, tile / width, reachable);
+                for (int32_t id : reachable) {
+                    Edge e = {id, computeOctile(tile, _subgoals[id]), -1};
+                    edges.push_back(e);
+                }
+            }
+            
+            std::vector<int32_t> subgoalPath;
+            if(startEdges.empty() || goalEdges.empty()
+               || (_contracted ? searchUpward(startEdges, goalEdges, subgoalPath)
+                   : searchGraph(startEdges, goalEdges, toTile, subgoalPath)) < 0){
+                result.clear();
+                return result;
+            }
+            
+            std::vector<int32_t> unpacked(1, subgoalPath.front());
+            for (size_t i = 1; i < subgoalPath.size(); i ++) {
+                unpackEdge(subgoalPath[i - 1], subgoalPath[i], unpacked);
+            }
+            
+            // every edge is h-reachable so it refine to tiles
+            ssize_t prev = fromTile;
+            for (int32_t id : unpacked) {
+                if(!refineSegment(prev, _subgoals[id], result)){
+                    result.clear();
+                    return result;
+                }
+                prev = _subgoals[id];
+            }
+            if(!refineSegment(prev, toTile, result)){
+                result.clear();
+            }
+            
+            return result;
+        }
+    }
+}
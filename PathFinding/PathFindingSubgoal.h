@@ -0,0 +1,117 @@
+/****************************************************************************
+ Copyright (c) 2015 QuanNguyen
+ 
+ http://quannguyen.info
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+
+#ifndef __Funny_PathFinding__Subgoal__
+#define __Funny_PathFinding__Subgoal__
+
+#include "cocos2d.h"
+#include "CollisionData.h"
+
+namespace pathfinding {
+    
+    namespace subgoal {
+        
+        struct Edge {
+            int32_t to;
+            float cost;
+            int32_t via;    // contracted subgoal in the middle of a shortcut, -1 for a real edge
+        };
+        
+        /**
+         *  Subgoal graph for static 8-connected maps (same moves as dijkstra::PathFinding).
+         *
+         *  Subgoals are placed at the convex corners of the obstacles and connected when they are
+         *  directly h-reachable (a free octile path with no other subgoal on it).
+         *  A query connect start and goal to the graph, search the small graph and refine every edge
+         *  back to tiles, the path is optimal.
+         *
+         *  With contraction the subgoals are also ordered and shortcut (contraction hierarchy),
+         *  a query is then 2 upward searches which only see a tiny part of the graph.
+         *
+         *  Setup again after the map changed.
+         */
+        class PathFinding : public cocos2d::Ref {
+            
+        public:
+            
+            PathFinding();
+            virtual ~PathFinding();
+            
+            CREATE_FUNC(PathFinding);
+            
+            /**
+             *  build the subgoal graph
+             *  @param contract true to build the contraction hierarchy on top of the graph
+             */
+            void setupMap(CollisionData* map, bool contract = false);
+            
+            std::vector<cocos2d::Vec2> getShortestPath(const cocos2d::Vec2& fromCoord,
+                                                       const cocos2d::Vec2& toCoord);
+            
+            inline int getSubgoalCount() const {
+                return (int)_subgoals.size();
+            }
+            
+            int getEdgeCount() const;
+            
+        protected:
+            virtual bool init();
+            
+            CC_SYNTHESIZE_READONLY(CollisionData *, _map, Map);
+            CC_SYNTHESIZE_READONLY(bool, _contracted, Contracted);
+            
+            std::vector<int32_t> _ids;          // tile -> subgoal id, -1 if not a subgoal
+            std::vector<ssize_t> _subgoals;     // subgoal id -> tile
+            std::vector<std::vector<Edge> > _edges;     // full subgoal graph
+            std::vector<std::vector<Edge> > _upward;    // edges to higher subgoals when contracted
+            std::vector<int32_t> _order;        // contraction rank
+            
+            void generateGraph();
+            void contractGraph();
+            
+            void findDirectHReachable(int x, int y, std::vector<int32_t>& result);
+            bool refineSegment(ssize_t fromTile, ssize_t toTile, std::vector<cocos2d::Vec2>& result);
+            void unpackEdge(int32_t from, int32_t to, std::vector<int32_t>& result);
+            
+            float searchGraph(const std::vector<Edge>& startEdges, const std::vector<Edge>& goalEdges,
+                              ssize_t goalTile, std::vector<int32_t>& result);
+            float searchUpward(const std::vector<Edge>& startEdges, const std::vector<Edge>& goalEdges,
+                               std::vector<int32_t>& result);
+            
+            inline bool isFree(int x, int y){
+                return (x >= 0 && x < (int)_map->getWidth() && y >= 0 && y < (int)_map->getHeight()
+                        && !_map->haveCollisionAtCoord(x, y));
+            }
+            
+            inline float computeOctile(ssize_t fromTile, ssize_t toTile){
+                int w = _map->getWidth();
+                int dx = std::abs((int)(toTile % w) - (int)(fromTile % w));
+                int dy = std::abs((int)(toTile / w) - (int)(fromTile / w));
+                return std::max(dx, dy) + (M_SQRT2 - 1) * std::min(dx, dy);
+            }
+        };
+    }
+}
+
+#endif /* defined(__Funny_PathFinding__Subgoal__) */
@@ -0,0 +1,328 @@
+/****************************************************************************
+ Copyright (c) 2015 QuanNguyen
+ 
+ http://quannguyen.info
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+
+#include "PathJobSystem.h"
+#include "PathFindingAstar.h"
+#include "PathFindingDijkstra.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <tuple>
+
+USING_NS_CC;
+
+namespace pathfinding {
+    
+    // the queues are polled during a search so the duplicates can join it
+    static const int kCollectInterval = 256;
+    
+    typedef std::tuple<int, int, int, int, int, int, bool> JobKey;
+    
+    static JobKey makeKey(const PathRequest& request)
+    {
+        return JobKey(request.from.x, request.from.y, request.to.x, request.to.y,
+                      request.engine, request.agentSize, request.bidirectional);
+    }
+    
+    /**
+     *  identical jobs share one search
+     */
+    struct JobGroup {
+        JobKey key;
+        std::vector<PathJobHandle> jobs;
+    };
+    
+    struct PathJobSystem::Worker {
+        PathJobSystem* _system;
+        MpscQueue<PathJobHandle> _queues[PATH_PRIORITY_COUNT];
+        std::deque<JobGroup *> _waiting[PATH_PRIORITY_COUNT];
+        std::map<JobKey, JobGroup *> _groups;
+        int _collectCountdown;
+        
+        Astar::PathFinding* _astar;
+        dijkstra::PathFinding* _dijkstra;
+        
+        std::thread _thread;
+        std::mutex _mutex;
+        std::condition_variable _condition;
+        std::atomic<bool> _sleeping;
+        std::atomic<bool> _stop;
+        bool _signaled;
+        
+        Worker(PathJobSystem* system) :
+        _system(system),
+        _collectCountdown(kCollectInterval),
+        _astar(nullptr),
+        _dijkstra(nullptr),
+        _sleeping(false),
+        _stop(false),
+        _signaled(false)
+        {
+            // created on the main thread, the autorelease pool is not thread safe
+            _astar = Astar::PathFinding::create();
+            _astar->retain();
+            _astar->setupMap(system->getMap());
+            _dijkstra = dijkstra::PathFinding::create();
+            _dijkstra->retain();
+            _dijkstra->setupMap(system->getMap());
+        }
+        
+        ~Worker()
+        {
+            for (int p = 0; p < PATH_PRIORITY_COUNT; p ++) {
+                for (auto group : _waiting[p]) {
+                    delete group;
+                }
+            }
+            CC_SAFE_RELEASE(_astar);
+            CC_SAFE_RELEASE(_dijkstra);
+        }
+        
+        void wake()
+        {
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _signaled = true;
+            }
+            _condition.notify_one();
+        }
+        
+        /**
+         *  move the submitted jobs to the waiting groups
+         *  @return true if a job was found
+         */
+        bool collectJobs()
+        {
+            bool found = false;
+            for (int p = 0; p < PATH_PRIORITY_COUNT; p ++) {
+                PathJobHandle job;
+                while (_queues[p].pop(job)) {
+                    found = true;
+                    JobKey key = makeKey(job->getRequest());
+                    auto ite = _groups.find(key);
+                    if(ite != _groups.end()){
+                        ite->second->jobs.push_back(job);
+                        continue;
+                    }
+                    
+                    JobGroup* group = new JobGroup();
+                    group->key = key;
+                    group->jobs.push_back(job);
+                    _groups[key] = group;
+                    _waiting[p].push_back(group);
+                }
+            }
+            return found;
+        }
+        
+        JobGroup* nextGroup()
+        {
+            for (int p = 0; p < PATH_PRIORITY_COUNT; p ++) {
+                if(!_waiting[p].empty()){
+                    JobGroup* group = _waiting[p].front();
+                    _waiting[p].pop_front();
+                    return group;
+                }
+            }
+            return nullptr;
+        }
+        
+        bool isCancelled(JobGroup* group)
+        {
+            if(-- _collectCountdown <= 0){
+                _collectCountdown = kCollectInterval;
+                collectJobs();
+            }
+            for (auto& job : group->jobs) {
+                if(!job->isCancelled()){
+                    return false;
+                }
+            }
+            return true;
+        }
+        
+        void process(JobGroup* group)
+        {
+            const PathRequest& request = group->jobs.front()->getRequest();
+            std::vector<Vec2> path;
+            SearchStats stats;
+            
+            if(isCancelled(group)){
+                stats.cancelled = true;
+            }
+            else if(request.engine == PATH_ENGINE_DIJKSTRA){
+                _dijkstra->setAgentSize(request.agentSize);
+                _dijkstra->setBidirectional(request.bidirectional);
+                _dijkstra->setCancelCheck([this, group]() { return isCancelled(group); });
+                path = _dijkstra->getShortestPath(request.from, request.to);
+                stats = _dijkstra->getStats();
+                _dijkstra->setCancelCheck(nullptr);
+            }
+            else{
+                _astar->setAgentSize(request.agentSize);
+                _astar->setBidirectional(request.bidirectional);
+                _astar->setCancelCheck([this, group]() { return isCancelled(group); });
+                path = _astar->getShortestPath(request.from, request.to);
+                stats = _astar->getStats();
+                _astar->setCancelCheck(nullptr);
+            }
+            
+            // no more duplicates can join, one result per job
+            _groups.erase(group->key);
+            for (auto& job : group->jobs) {
+                Delivery delivery;
+                delivery.job = job;
+                delivery.result.jobId = job->getId();
+                delivery.result.cancelled = stats.cancelled || job->isCancelled();
+                if(!delivery.result.cancelled){
+                    delivery.result.path = path;
+                }
+                delivery.result.stats = stats;
+                _system->_results.push(std::move(delivery));
+                _system->_pending --;
+            }
+            delete group;
+        }
+        
+        void run()
+        {
+            while (!_stop.load()) {
+                collectJobs();
+                JobGroup* group = nextGroup();
+                if(group){
+                    process(group);
+                    continue;
+                }
+                
+                std::unique_lock<std::mutex> lock(_mutex);
+                _sleeping.store(true);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                
+                // a job pushed before _sleeping was set didn't wake us
+                if(collectJobs()){
+                    _sleeping.store(false);
+                    continue;
+                }
+                _condition.wait(lock, [this]() { return _signaled || _stop.load(); });
+                _signaled = false;
+                _sleeping.store(false);
+            }
+        }
+    };
+    
+    PathJobSystem* PathJobSystem::create(CollisionData *map, int workerCount)
+    {
+        PathJobSystem* system = new PathJobSystem();
+        if(system->init(map, workerCount)){
+            system->autorelease();
+            return system;
+        }
+        CC_SAFE_DELETE(system);
+        return nullptr;
+    }
+    
+    PathJobSystem::PathJobSystem() :
+    _nextId(1),
+    _pending(0),
+    _map(nullptr)
+    {
+        
+    }
+    
+    PathJobSystem::~PathJobSystem()
+    {
+        for (auto worker : _workers) {
+            worker->_stop.store(true);
+            worker->wake();
+        }
+        for (auto worker : _workers) {
+            worker->_thread.join();
+            delete worker;
+        }
+        _workers.clear();
+    }
+    
+    bool PathJobSystem::init(CollisionData *map, int workerCount)
+    {
+        CCASSERT(map, "Map must be not null");
+        _map = map;
+        
+        if(workerCount <= 0){
+            workerCount = std::max(1, (int)std::thread::hardware_concurrency() - 1);
+        }
+        for (int i = 0; i < workerCount; i ++) {
+            _workers.push_back(new Worker(this));
+        }
+        for (auto worker : _workers) {
+            worker->_thread = std::thread(&Worker::run, worker);
+        }
+        return true;
+    }
+    
+    PathJobHandle PathJobSystem::submit(const PathRequest &request, const PathCallback &callback)
+    {
+        PathJobHandle job = std::make_shared<PathJob>();
+        job->_id = _nextId ++;
+        job->_request = request;
+        job->_callback = callback;
+        
+        // identical requests go to the same worker so it can merge them
+        JobKey key = makeKey(request);
+        size_t hash = std::get<0>(key) * 73856093u ^ std::get<1>(key) * 19349663u ^
+        std::get<2>(key) * 83492791u ^ std::get<3>(key) * 50331653u ^ std::get<4>(key) ^ (std::get<5>(key) << 4);
+        Worker* worker = _workers[hash % _workers.size()];
+        
+        _pending ++;
+        int priority = std::max(0, std::min((int)PATH_PRIORITY_COUNT - 1, (int)request.priority));
+        worker->_queues[priority].push(job);
+        
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(worker->_sleeping.load()){
+            worker->wake();
+        }
+        return job;
+    }
+    
+    int PathJobSystem::drainResults(int maxCount)
+    {
+        int count = 0;
+        Delivery delivery;
+        while ((maxCount < 0 || count < maxCount) && _results.pop(delivery)) {
+            if(delivery.job->_callback){
+                delivery.job->_callback(delivery.result);
+            }
+            count ++;
+        }
+        return count;
+    }
+    
+    void PathJobSystem::waitIdle()
+    {
+        while (_pending.load() > 0) {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+    }
+}
@@ -0,0 +1,202 @@
+/****************************************************************************
+ Copyright (c) 2015 QuanNguyen
+ 
+ http://quannguyen.info
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+
+#ifndef __Funny_PathFinding__PathJobSystem__
+#define __Funny_PathFinding__PathJobSystem__
+
+#include "cocos2d.h"
+#include "CollisionData.h"
+#include "PathFindingBidirectional.h"
+#include "MpscQueue.h"
+#include <atomic>
+#include <memory>
+
+namespace pathfinding {
+    
+    enum PathPriority {
+        PATH_PRIORITY_HIGH,
+        PATH_PRIORITY_NORMAL,
+        PATH_PRIORITY_LOW,
+        PATH_PRIORITY_COUNT
+    };
+    
+    enum PathEngine {
+        PATH_ENGINE_ASTAR,
+        PATH_ENGINE_DIJKSTRA
+    };
+    
+    struct PathRequest {
+        PathRequest() :
+        engine(PATH_ENGINE_ASTAR),
+        priority(PATH_PRIORITY_NORMAL),
+        agentSize(1),
+        bidirectional(false)
+        {
+        };
+        
+        cocos2d::Vec2 from;
+        cocos2d::Vec2 to;
+        PathEngine engine;
+        PathPriority priority;
+        int agentSize;
+        bool bidirectional;
+    };
+    
+    struct PathResult {
+        PathResult() :
+        jobId(0),
+        cancelled(false)
+        {
+        };
+        
+        int jobId;
+        
+        /** the job was cancelled, the path is empty */
+        bool cancelled;
+        
+        /** same as getShortestPath of the engine */
+        std::vector<cocos2d::Vec2> path;
+        
+        SearchStats stats;
+    };
+    
+    typedef std::function<void(const PathResult&)> PathCallback;
+    
+    /**
+     *  a submitted request, shared by the caller and the system
+     */
+    class PathJob {
+        
+    public:
+        PathJob() :
+        _id(0),
+        _cancelled(false)
+        {
+        };
+        
+        inline int getId() const {
+            return _id;
+        }
+        
+        inline const PathRequest& getRequest() const {
+            return _request;
+        }
+        
+        /**
+         *  thread safe, the search stop at its next expansion (once all the jobs sharing it are cancelled)
+         *  and the callback receive a cancelled result
+         */
+        inline void cancel() {
+            _cancelled.store(true, std::memory_order_relaxed);
+        }
+        
+        inline bool isCancelled() const {
+            return _cancelled.load(std::memory_order_relaxed);
+        }
+        
+    protected:
+        friend class PathJobSystem;
+        
+        int _id;
+        PathRequest _request;
+        PathCallback _callback;
+        std::atomic<bool> _cancelled;
+    };
+    
+    typedef std::shared_ptr<PathJob> PathJobHandle;
+    
+    /**
+     *  Run the path searches on background threads.
+     *
+     *  Every worker own its engines (so their search state is reused) and a lock free queue per
+     *  priority class. A request always go to the same worker, which merge it with an identical
+     *  request waiting or running: one search, one result for each job.
+     *  The results wait in a lock free queue until drainResults() call the callbacks, so call it
+     *  from the update of the scene and the callbacks run on the main thread.
+     *
+     *  The map is read by the workers: change it only when getPendingCount() is 0 (see waitIdle),
+     *  the engines see the change at their next search.
+     */
+    class PathJobSystem : public cocos2d::Ref {
+        
+    public:
+        
+        /**
+         *  @param workerCount 0 to use the number of cores - 1 (at least 1)
+         */
+        static PathJobSystem* create(CollisionData* map, int workerCount = 0);
+        
+        virtual ~PathJobSystem();
+        
+        /**
+         *  thread safe, never block
+         *  @return the job, keep it to cancel the request
+         */
+        PathJobHandle submit(const PathRequest& request, const PathCallback& callback);
+        
+        /**
+         *  call the callbacks of the finished jobs, main thread only
+         *  @param maxCount -1 for all the results
+         *  @return number of callbacks called
+         */
+        int drainResults(int maxCount = -1);
+        
+        /**
+         *  block until every submitted job is finished (the results still need drainResults)
+         */
+        void waitIdle();
+        
+        /**
+         *  jobs submitted and not finished yet
+         */
+        inline int getPendingCount() const {
+            return _pending.load();
+        }
+        
+        inline int getWorkerCount() const {
+            return (int)_workers.size();
+        }
+        
+    protected:
+        struct Worker;
+        friend struct Worker;
+        
+        struct Delivery {
+            PathJobHandle job;
+            PathResult result;
+        };
+        
+        PathJobSystem();
+        bool init(CollisionData* map, int workerCount);
+        
+        std::vector<Worker *> _workers;
+        MpscQueue<Delivery> _results;
+        std::atomic<int> _nextId;
+        std::atomic<int> _pending;
+        
+        CC_SYNTHESIZE_READONLY(CollisionData *, _map, Map);
+    };
+}
+
+#endif /* defined(__Funny_PathFinding__PathJobSystem__) */
@@ -0,0 +1,308 @@
+/****************************************************************************
+ Copyright (c) 2015 QuanNguyen
+ 
+ http://quannguyen.info
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+
+#include "PathTrace.h"
+
+USING_NS_CC;
+
+namespace pathfinding {
+    namespace trace {
+        
+        // header of the trace files, the ring of records follow it
+        struct TraceFileHeader {
+            char magic[4];
+            uint32_t formatVersion;
+            uint32_t recordSize;
+            uint32_t reserved;
+            uint64_t capacity;
+            /** records written since the start, the slot of a record is its sequence % capacity */
+            uint64_t count;
+        };
+        
+        static const char kTraceFileMagic[4] = {'P', 'T', 'R', 'C'};
+        static const uint32_t kTraceFileVersion = 1;
+        static const size_t kBufferSize = 4096;
+        
+        static_assert(sizeof(TraceRecord) == 48, "Trace records must keep their size");
+        
+        const size_t TraceRecorder::kDefaultCapacity;
+        
+        float getPathCost(const std::vector<Vec2>& path)
+        {
+            float cost = 0;
+            for (size_t i = 1; i < path.size(); i ++) {
+                cost += path[i].distance(path[i - 1]);
+            }
+            return cost;
+        }
+        
+        float getPathCost(const PathBuffer& path)
+        {
+            float cost = 0;
+            auto previous = path.begin();
+            for (auto ite = path.begin(); ite != path.end(); previous = ite, ++ ite) {
+                cost += (*ite).distance(*previous);
+            }
+            return cost;
+        }
+        
+        bool loadTrace(const std::string& fileName, std::vector<TraceRecord>& records, bool* wrapped)
+        {
+            FILE* file = fopen(fileName.c_str(), "rb");
+            if(!file){
+                return false;
+            }
+            
+            TraceFileHeader header;
+            bool valid = fread(&header, sizeof(header), 1, file) == 1
+                && memcmp(header.magic, kTraceFileMagic, sizeof(kTraceFileMagic)) == 0
+                && header.formatVersion == kTraceFileVersion
+                && header.recordSize == sizeof(TraceRecord)
+                && header.capacity > 0;
+            
+            if(valid){
+                records.resize((size_t)std::min(header.count, header.capacity));
+                valid = fread(records.data(), sizeof(TraceRecord), records.size(), file) == records.size();
+            }
+            fclose(file);
+            
+            if(!valid){
+                records.clear();
+                return false;
+            }
+            
+            // the ring start at the oldest record
+            std::sort(records.begin(), records.end(), [](const TraceRecord& a, const TraceRecord& b) {
+                return a.sequence < b.sequence;
+            });
+            if(wrapped){
+                *wrapped = header.count > header.capacity;
+            }
+            return true;
+        }
+        
+        TraceRecorder::TraceRecorder() :
+        _file(nullptr),
+        _capacity(0),
+        _sequence(0),
+        _written(0),
+        _nextMapId(0)
+        {
+        }
+        
+        TraceRecorder::~TraceRecorder()
+        {
+            for (auto& item : _maps) {
+                item.first->removeListener(this);
+            }
+            if(_file){
+                flush();
+                fclose(_file);
+            }
+        }
+        
+        TraceRecorder* TraceRecorder::create(const std::string& fileName, size_t capacity)
+        {
+            TraceRecorder* recorder = new (std::nothrow) TraceRecorder();
+            if(recorder && recorder->init(fileName, capacity)){
+                recorder->autorelease();
+                return recorder;
+            }
+            CC_SAFE_DELETE(recorder);
+            return nullptr;
+        }
+        
+        bool TraceRecorder::init(const std::string& fileName, size_t capacity)
+        {
+            CCASSERT(capacity > 0, "The ring must have room for a record");
+            
+            _file = fopen(fileName.c_str(), "wb+");
+            if(!_file){
+                CCLOG("Can't create trace file %s", fileName.c_str());
+                return false;
+            }
+            _capacity = capacity;
+            _buffer.reserve(kBufferSize);
+            writeRecords();
+            return true;
+        }
+        
+        void TraceRecorder::addMap(CollisionData* map, uint32_t mapId)
+        {
+            CCASSERT(map, "Map must be not null");
+            std::lock_guard<std::mutex> lock(_mutex);
+            
+            _nextMapId = std::max(_nextMapId, mapId + 1);
+            appendMap(map, mapId);
+            for (auto& item : _maps) {
+                if(item.first == map){
+                    item.second = mapId;
+                    return;
+                }
+            }
+            _maps.push_back(std::make_pair(map, mapId));
+            map->addListener(this);
+        }
+        
+        void TraceRecorder::removeMap(CollisionData* map)
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            
+            for (auto ite = _maps.begin(); ite != _maps.end(); ++ ite) {
+                if(ite->first == map){
+                    map->removeListener(this);
+                    _maps.erase(ite);
+                    return;
+                }
+            }
+        }
+        
+        void TraceRecorder::registerMap(CollisionData* map)
+        {
+            CCASSERT(map, "Map must be not null");
+            std::lock_guard<std::mutex> lock(_mutex);
+            getMapId(map);
+        }
+        
+        uint32_t TraceRecorder::getMapId(CollisionData* map)
+        {
+            for (auto& item : _maps) {
+                if(item.first == map){
+                    return item.second;
+                }
+            }
+            
+            uint32_t mapId = _nextMapId ++;
+            CCLOG("Trace: map %p recorded with id %u", map, mapId);
+            appendMap(map, mapId);
+            _maps.push_back(std::make_pair(map, mapId));
+            map->addListener(this);
+            return mapId;
+        }
+        
+        void TraceRecorder::recordQuery(CollisionData* map, unsigned int mapVersion, TraceEngine engine, int flags, int agentSize,
+                                        const Vec2& fromCoord, const Vec2& toCoord,
+                                        float cost, uint32_t microseconds)
+        {
+            TraceRecord record;
+            memset(&record, 0, sizeof(record));
+            record.type = RECORD_QUERY;
+            record.engine = engine;
+            record.flags = flags;
+            record.agentSize = std::min(agentSize, 255);
+            record.mapVersion = mapVersion;
+            record.fromX = fromCoord.x;
+            record.fromY = fromCoord.y;
+            record.toX = toCoord.x;
+            record.toY = toCoord.y;
+            record.cost = cost;
+            record.microseconds = microseconds;
+            
+            std::lock_guard<std::mutex> lock(_mutex);
+            record.mapId = getMapId(map);
+            append(record);
+        }
+        
+        void TraceRecorder::onCollisionChanged(CollisionData* map, int x, int y, bool coli)
+        {
+            TraceRecord record;
+            memset(&record, 0, sizeof(record));
+            record.type = RECORD_EDIT;
+            record.flags = coli ? RECORD_FLAG_COLLISION : 0;
+            record.mapVersion = map->getVersion();
+            record.fromX = x;
+            record.fromY = y;
+            
+            std::lock_guard<std::mutex> lock(_mutex);
+            record.mapId = getMapId(map);
+            append(record);
+        }
+        
+        void TraceRecorder::onCollisionDataDestroyed(CollisionData* map)
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            
+            // the map is going away, its listeners with it
+            for (auto ite = _maps.begin(); ite != _maps.end(); ++ ite) {
+                if(ite->first == map){
+                    _maps.erase(ite);
+                    return;
+                }
+            }
+        }
+        
+        void TraceRecorder::append(TraceRecord& record)
+        {
+            record.sequence = _sequence ++;
+            _buffer.push_back(record);
+            if(_buffer.size() >= kBufferSize){
+                writeRecords();
+            }
+        }
+        
+        void TraceRecorder::appendMap(CollisionData* map, uint32_t mapId)
+        {
+            // the replay know the version the next records start from
+            TraceRecord record;
+            memset(&record, 0, sizeof(record));
+            record.type = RECORD_MAP;
+            record.mapId = mapId;
+            record.mapVersion = map->getVersion();
+            append(record);
+        }
+        
+        void TraceRecorder::flush()
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            writeRecords();
+        }
+        
+        void TraceRecorder::writeRecords()
+        {
+            // the buffer is contiguous in the ring, except where it wrap
+            size_t done = 0;
+            while (done < _buffer.size()) {
+                size_t slot = (size_t)(_buffer[done].sequence % _capacity);
+                size_t count = std::min(_buffer.size() - done, _capacity - slot);
+                fseek(_file, sizeof(TraceFileHeader) + slot * sizeof(TraceRecord), SEEK_SET);
+                fwrite(&_buffer[done], sizeof(TraceRecord), count, _file);
+                done += count;
+            }
+            _written += _buffer.size();
+            _buffer.clear();
+            
+            // the header last, a crash lose at most the buffered records
+            TraceFileHeader header;
+            memcpy(header.magic, kTraceFileMagic, sizeof(kTraceFileMagic));
+            header.formatVersion = kTraceFileVersion;
+            header.recordSize = sizeof(TraceRecord);
+            header.reserved = 0;
+            header.capacity = _capacity;
+            header.count = _written;
+            fseek(_file, 0, SEEK_SET);
+            fwrite(&header, sizeof(header), 1, _file);
+            fflush(_file);
+        }
+    }
+}
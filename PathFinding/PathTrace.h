@@ -0,0 +1,211 @@
+/****************************************************************************
+ Copyright (c) 2015 QuanNguyen
+ 
+ http://quannguyen.info
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+
+#ifndef __Funny_PathFinding__PathTrace__
+#define __Funny_PathFinding__PathTrace__
+
+#include "cocos2d.h"
+#include "CollisionData.h"
+#include "PathBuffer.h"
+#include <chrono>
+#include <mutex>
+
+namespace pathfinding {
+    namespace trace {
+        
+        enum RecordType {
+            RECORD_QUERY = 1,
+            RECORD_EDIT = 2,
+            /** the map was added to the recorder, mapVersion is its version then */
+            RECORD_MAP = 3
+        };
+        
+        enum TraceEngine {
+            TRACE_ENGINE_ASTAR = 0,
+            TRACE_ENGINE_DIJKSTRA = 1
+        };
+        
+        enum RecordFlags {
+            RECORD_FLAG_BIDIRECTIONAL = 1,
+            /** query: a path was found */
+            RECORD_FLAG_FOUND = 2,
+            /** edit: the tile became a collision */
+            RECORD_FLAG_COLLISION = 4
+        };
+        
+        /**
+         *  one record of a trace file, 48 bytes in the byte order of the recording machine
+         */
+        struct TraceRecord {
+            /** position in the whole recording, the ring keep the highest ones */
+            uint64_t sequence;
+            uint32_t mapId;
+            /** query: version before the search, edit: version after the change, map: version when added */
+            uint32_t mapVersion;
+            /** edit: the tile is (fromX, fromY) */
+            int32_t fromX;
+            int32_t fromY;
+            int32_t toX;
+            int32_t toY;
+            /** sum of the steps of the path, 1 or sqrt(2) each */
+            float cost;
+            /** search time */
+            uint32_t microseconds;
+            uint8_t type;
+            uint8_t engine;
+            uint8_t flags;
+            uint8_t agentSize;
+            uint32_t reserved;
+        };
+        
+        /**
+         *  @return the cost recorded for a path
+         */
+        float getPathCost(const std::vector<cocos2d::Vec2>& path);
+        float getPathCost(const PathBuffer& path);
+        
+        /**
+         *  read the records of a trace file, oldest first
+         *  @param wrapped if not null, set to true when the oldest records were overwritten by the ring
+         *  @return false if the file is not a trace
+         */
+        bool loadTrace(const std::string& fileName, std::vector<TraceRecord>& records, bool* wrapped = nullptr);
+        
+        /**
+         *  Record the queries of the engines and the edits of their maps to a file, to replay the
+         *  real load with TraceReplayer.
+         *
+         *  The file is a ring of fixed size records: once full the oldest ones are overwritten, so a
+         *  recorder can stay enabled in production. The records are buffered and written by flush().
+         *  Give it to the engines with setRecorder, their map is added then (or by setupMap) with the
+         *  next free id, or call addMap first to choose the ids. A deleted map is forgotten. Thread safe.
+         */
+        class TraceRecorder : public cocos2d::Ref, public CollisionListener {
+            
+        public:
+            /**
+             *  @param capacity number of records kept by the file
+             */
+            static TraceRecorder* create(const std::string& fileName, size_t capacity = kDefaultCapacity);
+            
+            virtual ~TraceRecorder();
+            
+            /**
+             *  record the queries on this map with this id, and its edits (through setCollisionInfo)
+             *  a deleted map is removed by onCollisionDataDestroyed
+             */
+            void addMap(CollisionData* map, uint32_t mapId);
+            void removeMap(CollisionData* map);
+            
+            /**
+             *  add the map with the next free id if it is not recorded yet
+             */
+            void registerMap(CollisionData* map);
+            
+            void recordQuery(CollisionData* map, unsigned int mapVersion, TraceEngine engine, int flags, int agentSize,
+                             const cocos2d::Vec2& fromCoord, const cocos2d::Vec2& toCoord,
+                             float cost, uint32_t microseconds);
+            
+            virtual void onCollisionChanged(CollisionData* map, int x, int y, bool coli) override;
+            virtual void onCollisionDataDestroyed(CollisionData* map) override;
+            
+            /**
+             *  write the buffered records, also done when the buffer is full and by the destructor
+             */
+            void flush();
+            
+            inline uint64_t getRecordCount() {
+                std::lock_guard<std::mutex> lock(_mutex);
+                return _sequence;
+            }
+            
+            static const size_t kDefaultCapacity = 1 << 20;
+            
+        protected:
+            TraceRecorder();
+            bool init(const std::string& fileName, size_t capacity);
+            
+            void append(TraceRecord& record);
+            void appendMap(CollisionData* map, uint32_t mapId);
+            void writeRecords();
+            uint32_t getMapId(CollisionData* map);
+            
+            FILE* _file;
+            size_t _capacity;
+            uint64_t _sequence;
+            uint64_t _written;
+            std::vector<TraceRecord> _buffer;
+            std::vector<std::pair<CollisionData *, uint32_t>> _maps;
+            uint32_t _nextMapId;
+            std::mutex _mutex;
+        };
+        
+        /**
+         *  time one query of an engine and record it at finish, does nothing without recorder
+         */
+        class TraceQuery
+        {
+        public:
+            TraceQuery(TraceRecorder* recorder, CollisionData* map, TraceEngine engine, bool bidirectional, int agentSize,
+                       const cocos2d::Vec2& fromCoord, const cocos2d::Vec2& toCoord) :
+            _recorder(recorder)
+            {
+                if(recorder){
+                    _map = map;
+                    _version = map->getVersion();
+                    _engine = engine;
+                    _flags = bidirectional ? RECORD_FLAG_BIDIRECTIONAL : 0;
+                    _agentSize = agentSize;
+                    _from = fromCoord;
+                    _to = toCoord;
+                    _start = std::chrono::steady_clock::now();
+                }
+            };
+            
+            template <typename Path>
+            inline void finish(const Path& path) {
+                if(_recorder){
+                    auto time = std::chrono::steady_clock::now() - _start;
+                    uint32_t microseconds = (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(time).count();
+                    int flags = _flags | (path.empty() ? 0 : RECORD_FLAG_FOUND);
+                    _recorder->recordQuery(_map, _version, _engine, flags, _agentSize, _from, _to,
+                                           getPathCost(path), microseconds);
+                }
+            }
+            
+        protected:
+            TraceRecorder* _recorder;
+            CollisionData* _map;
+            unsigned int _version;
+            TraceEngine _engine;
+            int _flags;
+            int _agentSize;
+            cocos2d::Vec2 _from;
+            cocos2d::Vec2 _to;
+            std::chrono::steady_clock::time_point _start;
+        };
+    }
+}
+
+#endif /* defined(__Funny_PathFinding__PathTrace__) */
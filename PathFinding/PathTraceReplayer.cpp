@@ -0,0 +1,321 @@
+/****************************************************************************
+ Copyright (c) 2015 QuanNguyen
+ 
+ http://quannguyen.info
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+
+#include "PathTraceReplayer.h"
+#include "PathFindingAstar.h"
+#include "PathFindingDijkstra.h"
+#include <thread>
+
+USING_NS_CC;
+
+namespace pathfinding {
+    namespace trace {
+        
+        enum QueryResult {
+            RESULT_SAME,
+            RESULT_DIFFERENT,
+            RESULT_UNSYNCED
+        };
+        
+        struct TraceReplayer::Worker {
+            // by map id, the dijkstra graph is built at the first search and again when the map changed
+            std::vector<Astar::PathFinding *> astars;
+            std::vector<dijkstra::PathFinding *> dijkstras;
+            PathBuffer path;
+            
+            ~Worker()
+            {
+                for (auto engine : astars) {
+                    CC_SAFE_RELEASE(engine);
+                }
+                for (auto engine : dijkstras) {
+                    CC_SAFE_RELEASE(engine);
+                }
+            }
+        };
+        
+        static void computePercentiles(std::vector<float>& values, double* result)
+        {
+            static const double kPercentiles[3] = {0.5, 0.9, 0.99};
+            
+            std::sort(values.begin(), values.end());
+            for (int i = 0; i < 3; i ++) {
+                result[i] = values.empty() ? 0 : values[std::min(values.size() - 1, (size_t)(kPercentiles[i] * values.size()))];
+            }
+            result[3] = values.empty() ? 0 : values.back();
+        }
+        
+        std::string ReplayReport::getDescription() const
+        {
+            char text[512];
+            snprintf(text, sizeof(text),
+                     "%zu queries, %zu edits, %zu skipped%s\n"
+                     "%.3f s, %.0f queries/s\n"
+                     "latency us   p50 %.1f  p90 %.1f  p99 %.1f  max %.1f\n"
+                     "recorded us  p50 %.1f  p90 %.1f  p99 %.1f  max %.1f\n"
+                     "%zu cost differences, %zu queries not compared (map out of sync)",
+                     queries, edits, skipped, wrapped ? " (the ring wrapped, oldest records lost)" : "",
+                     seconds, queriesPerSecond,
+                     latency[0], latency[1], latency[2], latency[3],
+                     recordedLatency[0], recordedLatency[1], recordedLatency[2], recordedLatency[3],
+                     differences, unsynced);
+            return text;
+        }
+        
+        TraceReplayer::TraceReplayer() :
+        _wrapped(false),
+        _indexes(nullptr),
+        _next(0),
+        _generation(0),
+        _running(0),
+        _stopping(false)
+        {
+        }
+        
+        TraceReplayer::~TraceReplayer()
+        {
+        }
+        
+        bool TraceReplayer::initWithFile(const std::string& fileName)
+        {
+            return loadTrace(fileName, _records, &_wrapped);
+        }
+        
+        void TraceReplayer::addMap(uint32_t mapId, CollisionData* map)
+        {
+            if(_maps.size() <= mapId){
+                _maps.resize(mapId + 1, nullptr);
+            }
+            _maps[mapId] = map;
+        }
+        
+        ReplayReport TraceReplayer::replay(const ReplayOptions& options)
+        {
+            ReplayReport report;
+            report.wrapped = _wrapped;
+            _latencies.assign(_records.size(), 0);
+            _results.assign(_records.size(), RESULT_SAME);
+            
+            // the engines need the clearance map to replay the big agents
+            for (auto& record : _records) {
+                if(record.type == RECORD_QUERY && record.agentSize > 1 && record.mapId < _maps.size()
+                   && _maps[record.mapId] && !_maps[record.mapId]->getClearanceMap()){
+                    _maps[record.mapId]->enableClearanceMap();
+                }
+            }
+            
+            // created on the calling thread, the autorelease pool is not thread safe
+            std::vector<Worker *> workers;
+            for (int i = 0; i < std::max(1, options.threadCount); i ++) {
+                Worker* worker = new Worker();
+                for (auto map : _maps) {
+                    Astar::PathFinding* astar = nullptr;
+                    dijkstra::PathFinding* dijkstra = nullptr;
+                    if(map){
+                        astar = Astar::PathFinding::create();
+                        astar->retain();
+                        astar->setupMap(map);
+                        dijkstra = dijkstra::PathFinding::create();
+                        dijkstra->retain();
+                        dijkstra->setupMap(map);
+                    }
+                    worker->astars.push_back(astar);
+                    worker->dijkstras.push_back(dijkstra);
+                }
+                workers.push_back(worker);
+            }
+            
+            // last recorded version of every map, known from its registration or its first edit
+            std::vector<unsigned int> versions(_maps.size(), 0);
+            std::vector<bool> synced(_maps.size(), false);
+            std::vector<size_t> queries;
+            std::vector<float> recorded;
+            
+            std::vector<std::thread> threads;
+            _stopping = false;
+            if(workers.size() > 1){
+                for (auto worker : workers) {
+                    threads.push_back(std::thread(&TraceReplayer::workerLoop, this, worker, std::cref(options)));
+                }
+            }
+            
+            auto start = std::chrono::steady_clock::now();
+            double editSeconds = 0;
+            
+            for (size_t i = 0; i < _records.size(); i ++) {
+                const TraceRecord& record = _records[i];
+                if(record.mapId >= _maps.size() || _maps[record.mapId] == nullptr){
+                    report.skipped ++;
+                    continue;
+                }
+                
+                if(record.type == RECORD_QUERY){
+                    // once wrapped the lost edits can't be replayed, the map never match the recorded one
+                    if(_wrapped || (synced[record.mapId] && versions[record.mapId] != record.mapVersion)){
+                        _results[i] = RESULT_UNSYNCED;
+                    }
+                    queries.push_back(i);
+                    recorded.push_back(record.microseconds);
+                    report.queries ++;
+                    continue;
+                }
+                if(record.type == RECORD_MAP){
+                    // the recorded queries must see this version, else the given map is not the recorded one
+                    versions[record.mapId] = record.mapVersion;
+                    synced[record.mapId] = true;
+                    continue;
+                }
+                if(record.type != RECORD_EDIT){
+                    report.skipped ++;
+                    continue;
+                }
+                
+                // the queries before the edit see the map without it
+                runQueries(workers, queries, options);
+                queries.clear();
+                
+                auto editStart = std::chrono::steady_clock::now();
+                _maps[record.mapId]->setCollisionInfo(record.fromX, record.fromY, (record.flags & RECORD_FLAG_COLLISION) != 0);
+                editSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - editStart).count();
+                
+                versions[record.mapId] = record.mapVersion;
+                synced[record.mapId] = true;
+                report.edits ++;
+            }
+            runQueries(workers, queries, options);
+            
+            report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() - editSeconds;
+            report.queriesPerSecond = report.seconds > 0 ? report.queries / report.seconds : 0;
+            
+            std::vector<float> latencies;
+            for (size_t i = 0; i < _records.size(); i ++) {
+                const TraceRecord& record = _records[i];
+                if(record.type != RECORD_QUERY || record.mapId >= _maps.size() || _maps[record.mapId] == nullptr){
+                    continue;
+                }
+                latencies.push_back(_latencies[i]);
+                if(_results[i] == RESULT_DIFFERENT){
+                    report.differences ++;
+                }else if(_results[i] == RESULT_UNSYNCED){
+                    report.unsynced ++;
+                }
+            }
+            computePercentiles(latencies, report.latency);
+            computePercentiles(recorded, report.recordedLatency);
+            
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _stopping = true;
+            }
+            _condition.notify_all();
+            for (auto& thread : threads) {
+                thread.join();
+            }
+            for (auto worker : workers) {
+                delete worker;
+            }
+            return report;
+        }
+        
+        void TraceReplayer::runQueries(std::vector<Worker *>& workers, const std::vector<size_t>& indexes, const ReplayOptions& options)
+        {
+            if(indexes.empty()){
+                return;
+            }
+            if(workers.size() == 1 || indexes.size() == 1){
+                for (auto index : indexes) {
+                    runQuery(workers[0], index, options);
+                }
+                return;
+            }
+            
+            std::unique_lock<std::mutex> lock(_mutex);
+            _indexes = &indexes;
+            _next = 0;
+            _running = (int)workers.size();
+            _generation ++;
+            _condition.notify_all();
+            _finished.wait(lock, [this]() { return _running == 0; });
+        }
+        
+        void TraceReplayer::workerLoop(Worker* worker, const ReplayOptions& options)
+        {
+            unsigned int generation = 0;
+            while (true) {
+                const std::vector<size_t>* indexes;
+                {
+                    std::unique_lock<std::mutex> lock(_mutex);
+                    _condition.wait(lock, [this, generation]() { return _stopping || _generation != generation; });
+                    if(_stopping){
+                        return;
+                    }
+                    generation = _generation;
+                    indexes = _indexes;
+                }
+                
+                for (size_t i = _next ++; i < indexes->size(); i = _next ++) {
+                    runQuery(worker, (*indexes)[i], options);
+                }
+                
+                std::lock_guard<std::mutex> lock(_mutex);
+                if(-- _running == 0){
+                    _finished.notify_one();
+                }
+            }
+        }
+        
+        void TraceReplayer::runQuery(Worker* worker, size_t index, const ReplayOptions& options)
+        {
+            const TraceRecord& record = _records[index];
+            int engine = options.engine < 0 ? record.engine : options.engine;
+            bool bidirectional = options.bidirectional < 0 ? (record.flags & RECORD_FLAG_BIDIRECTIONAL) != 0 : options.bidirectional != 0;
+            Vec2 from(record.fromX, record.fromY);
+            Vec2 to(record.toX, record.toY);
+            
+            auto start = std::chrono::steady_clock::now();
+            if(engine == TRACE_ENGINE_DIJKSTRA){
+                auto dijkstra = worker->dijkstras[record.mapId];
+                dijkstra->setAgentSize(record.agentSize);
+                dijkstra->setBidirectional(bidirectional);
+                dijkstra->getShortestPath(from, to, worker->path);
+            }
+            else{
+                auto astar = worker->astars[record.mapId];
+                astar->setAgentSize(record.agentSize);
+                astar->setBidirectional(bidirectional);
+                astar->getShortestPath(from, to, worker->path);
+            }
+            _latencies[index] = std::chrono::duration<float, std::micro>(std::chrono::steady_clock::now() - start).count();
+            
+            if(_results[index] == RESULT_UNSYNCED){
+                return;
+            }
+            bool found = !worker->path.empty();
+            bool recordedFound = (record.flags & RECORD_FLAG_FOUND) != 0;
+            if(found != recordedFound || std::abs(getPathCost(worker->path) - record.cost) > options.costTolerance){
+                _results[index] = RESULT_DIFFERENT;
+            }
+        }
+    }
+}
@@ -0,0 +1,155 @@
+/****************************************************************************
+ Copyright (c) 2015 QuanNguyen
+ 
+ http://quannguyen.info
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+
+#ifndef __Funny_PathFinding__PathTraceReplayer__
+#define __Funny_PathFinding__PathTraceReplayer__
+
+#include "cocos2d.h"
+#include "CollisionData.h"
+#include "PathTrace.h"
+#include <atomic>
+#include <condition_variable>
+
+namespace pathfinding {
+    namespace trace {
+        
+        struct ReplayOptions {
+            ReplayOptions() :
+            engine(-1),
+            bidirectional(-1),
+            threadCount(1),
+            costTolerance(1e-3f)
+            {
+            };
+            
+            /** TraceEngine to run every query with, -1 for the recorded one */
+            int engine;
+            
+            /** 0 or 1 to force the search direction, -1 for the recorded one */
+            int bidirectional;
+            
+            /** the queries between two edits run in parallel, every thread with its own engines */
+            int threadCount;
+            
+            /** a path cost further than this from the recorded one is a difference */
+            float costTolerance;
+        };
+        
+        struct ReplayReport {
+            ReplayReport() :
+            queries(0),
+            edits(0),
+            skipped(0),
+            unsynced(0),
+            differences(0),
+            seconds(0),
+            queriesPerSecond(0),
+            wrapped(false)
+            {
+                for (int i = 0; i < 4; i ++) {
+                    latency[i] = 0;
+                    recordedLatency[i] = 0;
+                }
+            };
+            
+            size_t queries;
+            size_t edits;
+            
+            /** records of a map without addMap */
+            size_t skipped;
+            
+            /** queries run on a map state different from the recorded one (edits missing from the trace), not compared */
+            size_t unsynced;
+            
+            /** queries which found a path when the recorded one didn't (or the opposite), or with another cost */
+            size_t differences;
+            
+            /** wall time of the queries */
+            double seconds;
+            double queriesPerSecond;
+            
+            /** latency percentiles in microseconds: 50, 90, 99, max */
+            double latency[4];
+            double recordedLatency[4];
+            
+            /** the oldest records were lost with the edits before them, the queries are timed but not compared */
+            bool wrapped;
+            
+            std::string getDescription() const;
+        };
+        
+        /**
+         *  Run a trace of TraceRecorder again: the queries with the engines, the edits on the maps.
+         *
+         *  The maps are given by id as they were when added to the recorder, the replay change them.
+         */
+        class TraceReplayer
+        {
+        public:
+            TraceReplayer();
+            virtual ~TraceReplayer();
+            
+            bool initWithFile(const std::string& fileName);
+            
+            /**
+             *  the map of the records with this id, not owned
+             *  its clearance map is enabled by replay if the trace have agents bigger than a tile
+             */
+            void addMap(uint32_t mapId, CollisionData* map);
+            
+            ReplayReport replay(const ReplayOptions& options = ReplayOptions());
+            
+            inline const std::vector<TraceRecord>& getRecords() const {
+                return _records;
+            }
+            
+        protected:
+            struct Worker;
+            
+            void runQueries(std::vector<Worker *>& workers, const std::vector<size_t>& indexes, const ReplayOptions& options);
+            void runQuery(Worker* worker, size_t index, const ReplayOptions& options);
+            void workerLoop(Worker* worker, const ReplayOptions& options);
+            
+            std::vector<TraceRecord> _records;
+            std::vector<CollisionData *> _maps;
+            bool _wrapped;
+            
+            // per query of the current replay
+            std::vector<float> _latencies;
+            std::vector<char> _results;
+            
+            // the threads of a multi-threaded replay wait for the next queries between two edits
+            std::mutex _mutex;
+            std::condition_variable _condition;
+            std::condition_variable _finished;
+            const std::vector<size_t>* _indexes;
+            std::atomic<size_t> _next;
+            unsigned int _generation;
+            int _running;
+            bool _stopping;
+        };
+    }
+}
+
+#endif /* defined(__Funny_PathFinding__PathTraceReplayer__) */
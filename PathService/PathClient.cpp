@@ -0,0 +1,194 @@
+/****************************************************************************
+ Copyright (c) 2015 QuanNguyen
+ 
+ http://quannguyen.info
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+
+#include "PathClient.h"
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+USING_NS_CC;
+
+namespace pathfinding {
+    namespace service {
+        
+        PathClient::PathClient() :
+        _fd(-1),
+        _nextId(1),
+        _reader(nullptr)
+        {
+        }
+        
+        PathClient::~PathClient()
+        {
+            close();
+        }
+        
+        bool PathClient::connect(const std::string& socketPath)
+        {
+            struct sockaddr_un address;
+            if(socketPath.size() >= sizeof(address.sun_path)){
+                return false;
+            }
+            memset(&address, 0, sizeof(address));
+            address.sun_family = AF_UNIX;
+            memcpy(address.sun_path, socketPath.c_str(), socketPath.size());
+            
+            int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+            if(fd < 0){
+                return false;
+            }
+            if(::connect(fd, (struct sockaddr*)&address, sizeof(address)) != 0){
+                ::close(fd);
+                return false;
+            }
+            initWithSocket(fd);
+            return true;
+        }
+        
+        void PathClient::initWithSocket(int fd)
+        {
+            close();
+#if defined(SO_NOSIGPIPE)
+            int on = 1;
+            setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+            _fd = fd;
+            _reader = new FrameReader(fd);
+        }
+        
+        void PathClient::close()
+        {
+            if(_fd >= 0){
+                ::close(_fd);
+                _fd = -1;
+            }
+            CC_SAFE_DELETE(_reader);
+            _output.clear();
+            _received.clear();
+        }
+        
+        int PathClient::findPath(const std::string& map, const Vec2& fromCoord, const Vec2& toCoord,
+                                 PathBuffer& result, int flags, int agentSize)
+        {
+            ServiceResponse response;
+            uint32_t id = queuePath(map, fromCoord, toCoord, flags, agentSize);
+            if(!flush() || !receive(id, response)){
+                result.clear();
+                return STATUS_DISCONNECTED;
+            }
+            std::swap(result, response.path);
+            return response.status;
+        }
+        
+        int PathClient::hasLineOfSight(const std::string& map, const Vec2& fromCoord, const Vec2& toCoord)
+        {
+            ServiceResponse response;
+            uint32_t id = queueLineOfSight(map, fromCoord, toCoord);
+            if(!flush() || !receive(id, response)){
+                return STATUS_DISCONNECTED;
+            }
+            return response.status;
+        }
+        
+        uint32_t PathClient::queue(ServiceRequest& request, const std::string& map,
+                                   const Vec2& fromCoord, const Vec2& toCoord)
+        {
+            request.id = _nextId ++;
+            request.map = map;
+            request.fromX = (int32_t)fromCoord.x;
+            request.fromY = (int32_t)fromCoord.y;
+            request.toX = (int32_t)toCoord.x;
+            request.toY = (int32_t)toCoord.y;
+            encodeRequest(request, _output);
+            return request.id;
+        }
+        
+        uint32_t PathClient::queuePath(const std::string& map, const Vec2& fromCoord, const Vec2& toCoord,
+                                       int flags, int agentSize)
+        {
+            ServiceRequest request;
+            request.type = REQUEST_PATH;
+            request.flags = (uint8_t)flags;
+            request.agentSize = (uint8_t)agentSize;
+            return queue(request, map, fromCoord, toCoord);
+        }
+        
+        uint32_t PathClient::queueLineOfSight(const std::string& map, const Vec2& fromCoord, const Vec2& toCoord)
+        {
+            ServiceRequest request;
+            request.type = REQUEST_LINE_OF_SIGHT;
+            return queue(request, map, fromCoord, toCoord);
+        }
+        
+        bool PathClient::flush()
+        {
+            if(_fd < 0){
+                return false;
+            }
+            bool written = writeAll(_fd, _output.data(), _output.size());
+            _output.clear();
+            return written;
+        }
+        
+        bool PathClient::readResponse(ServiceResponse& response)
+        {
+            const uint8_t* body = nullptr;
+            size_t size = 0;
+            if(_reader == nullptr || !_reader->readFrame(body, size)){
+                return false;
+            }
+            return decodeResponse(body, size, response);
+        }
+        
+        bool PathClient::receive(ServiceResponse& response)
+        {
+            if(!_received.empty()){
+                std::swap(response, _received.front());
+                _received.pop_front();
+                return true;
+            }
+            return readResponse(response);
+        }
+        
+        bool PathClient::receive(uint32_t id, ServiceResponse& response)
+        {
+            for (auto ite = _received.begin(); ite != _received.end(); ++ ite) {
+                if(ite->id == id){
+                    std::swap(response, *ite);
+                    _received.erase(ite);
+                    return true;
+                }
+            }
+            
+            while (readResponse(response)) {
+                if(response.id == id){
+                    return true;
+                }
+                _received.push_back(response);
+            }
+            return false;
+        }
+    }
+}
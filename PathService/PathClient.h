@@ -0,0 +1,114 @@
+/****************************************************************************
+ Copyright (c) 2015 QuanNguyen
+ 
+ http://quannguyen.info
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+
+#ifndef __Funny_PathService__PathClient__
+#define __Funny_PathService__PathClient__
+
+#include "cocos2d.h"
+#include "PathServiceProtocol.h"
+#include <deque>
+
+namespace pathfinding {
+    namespace service {
+        
+        /**
+         *  Connection to a PathServer, one per thread.
+         *
+         *  findPath and hasLineOfSight wait for their answer; to send many queries at once
+         *  queue them, flush, then receive the responses (in any order, match the ids).
+         */
+        class PathClient
+        {
+        public:
+            PathClient();
+            virtual ~PathClient();
+            
+            /**
+             *  connect to the Unix domain socket of a server
+             */
+            bool connect(const std::string& socketPath);
+            
+            /**
+             *  use a socket already connected, e.g. one end of a socketpair, the client own it
+             */
+            void initWithSocket(int fd);
+            
+            void close();
+            
+            inline bool isConnected() const {
+                return _fd >= 0;
+            }
+            
+            /**
+             *  @param flags RequestFlags
+             *  @return STATUS_OK and the path in result, or the error status
+             */
+            int findPath(const std::string& map, const cocos2d::Vec2& fromCoord, const cocos2d::Vec2& toCoord,
+                         PathBuffer& result, int flags = 0, int agentSize = 1);
+            
+            /**
+             *  @return STATUS_OK if no tile between the two have collision, STATUS_BLOCKED if one have,
+             *  or the error status
+             */
+            int hasLineOfSight(const std::string& map, const cocos2d::Vec2& fromCoord, const cocos2d::Vec2& toCoord);
+            
+            /**
+             *  add a request to the next flush
+             *  @return the id of its response
+             */
+            uint32_t queuePath(const std::string& map, const cocos2d::Vec2& fromCoord, const cocos2d::Vec2& toCoord,
+                               int flags = 0, int agentSize = 1);
+            uint32_t queueLineOfSight(const std::string& map, const cocos2d::Vec2& fromCoord, const cocos2d::Vec2& toCoord);
+            
+            /**
+             *  send the queued requests with one write
+             */
+            bool flush();
+            
+            /**
+             *  wait for the next response
+             *  @return false if the connection is lost
+             */
+            bool receive(ServiceResponse& response);
+            
+            /**
+             *  wait for the response of a request, the other ones are kept for receive
+             */
+            bool receive(uint32_t id, ServiceResponse& response);
+            
+        protected:
+            uint32_t queue(ServiceRequest& request, const std::string& map,
+                           const cocos2d::Vec2& fromCoord, const cocos2d::Vec2& toCoord);
+            bool readResponse(ServiceResponse& response);
+            
+            int _fd;
+            uint32_t _nextId;
+            std::vector<uint8_t> _output;
+            FrameReader* _reader;
+            std::deque<ServiceResponse> _received;
+        };
+    }
+}
+
+#endif /* defined(__Funny_PathService__PathClient__) */
@@ -0,0 +1,486 @@
+/****************************************************************************
+ Copyright (c) 2015 QuanNguyen
+ 
+ http://quannguyen.info
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+
+#include "PathServer.h"
+#include "PathFindingAstar.h"
+#include "PathFindingDijkstra.h"
+
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+USING_NS_CC;
+
+namespace pathfinding {
+    namespace service {
+        
+        static const int kDefaultBatchWindow = 200;
+        static const int kDefaultMaxBatchSize = 256;
+        static const int kListenBacklog = 64;
+        
+        struct PathServer::Connection {
+            int fd;
+            std::mutex writeMutex;
+            
+            Connection(int socket) :
+            fd(socket)
+            {
+#if defined(SO_NOSIGPIPE)
+                int on = 1;
+                setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+            }
+            
+            ~Connection()
+            {
+                close(fd);
+            }
+        };
+        
+        struct PathServer::Worker {
+            // one engine of each kind per map, the dijkstra graph is built at its first search
+            std::vector<Astar::PathFinding *> astars;
+            std::vector<dijkstra::PathFinding *> dijkstras;
+            std::thread thread;
+            
+            ~Worker()
+            {
+                for (auto engine : astars) {
+                    engine->release();
+                }
+                for (auto engine : dijkstras) {
+                    engine->release();
+                }
+            }
+        };
+        
+        static inline bool isSameQuery(const ServiceRequest& a, const ServiceRequest& b)
+        {
+            return a.type == b.type && a.flags == b.flags && a.agentSize == b.agentSize
+                && a.fromX == b.fromX && a.fromY == b.fromY && a.toX == b.toX && a.toY == b.toY
+                && a.map == b.map;
+        }
+        
+        static inline bool isQueryBefore(const ServiceRequest& a, const ServiceRequest& b)
+        {
+            if(a.map != b.map) return a.map < b.map;
+            if(a.type != b.type) return a.type < b.type;
+            if(a.flags != b.flags) return a.flags < b.flags;
+            if(a.agentSize != b.agentSize) return a.agentSize < b.agentSize;
+            if(a.fromY != b.fromY) return a.fromY < b.fromY;
+            if(a.fromX != b.fromX) return a.fromX < b.fromX;
+            if(a.toY != b.toY) return a.toY < b.toY;
+            return a.toX < b.toX;
+        }
+        
+        PathServer::PathServer() :
+        _stopping(false),
+        _connectionCount(0),
+        _listenFd(-1),
+        _requestCount(0),
+        _batchCount(0),
+        _batchWindow(kDefaultBatchWindow),
+        _maxBatchSize(kDefaultMaxBatchSize)
+        {
+        }
+        
+        PathServer::~PathServer()
+        {
+            stop();
+            {
+                std::unique_lock<std::mutex> lock(_connectionsMutex);
+                _connectionsCondition.wait(lock, [this]() { return _connectionCount == 0; });
+            }
+            for (auto worker : _workers) {
+                delete worker;
+            }
+            for (auto& entry : _maps) {
+                delete entry.map;
+            }
+        }
+        
+        bool PathServer::loadMap(const std::string& name, const std::string& fileName)
+        {
+            auto map = new CollisionData();
+            bool loaded = CollisionData::isMappedFile(fileName) ? map->initWithMappedFile(fileName) : map->initWithFile(fileName);
+            if(loaded){
+                addMap(name, map);
+                return true;
+            }
+            CC_SAFE_DELETE(map);
+            return false;
+        }
+        
+        void PathServer::addMap(const std::string& name, CollisionData* map)
+        {
+            CCASSERT(_workers.empty(), "Add the maps before start");
+            CCASSERT(map && _mapIndexes.find(name) == _mapIndexes.end(), "Map must be not null and have a new name");
+            CCASSERT(name.size() <= kMaxMapNameSize, "Map name too long");
+            
+            // the requests can ask for agents bigger than a tile
+            if(!map->getClearanceMap()){
+                map->enableClearanceMap();
+            }
+            
+            MapEntry entry;
+            entry.name = name;
+            entry.map = map;
+            _mapIndexes[name] = (int)_maps.size();
+            _maps.push_back(entry);
+        }
+        
+        CollisionData* PathServer::getMap(const std::string& name) const
+        {
+            auto ite = _mapIndexes.find(name);
+            return ite == _mapIndexes.end() ? nullptr : _maps[ite->second].map;
+        }
+        
+        bool PathServer::start(int workerCount)
+        {
+            CCASSERT(_workers.empty(), "Server already started");
+            
+            if(workerCount <= 0){
+                workerCount = std::max(1, (int)std::thread::hardware_concurrency() - 1);
+            }
+            
+            for (int i = 0; i < workerCount; i ++) {
+                // created on the main thread, the autorelease pool is not thread safe
+                Worker* worker = new Worker();
+                for (auto& entry : _maps) {
+                    auto astar = Astar::PathFinding::create();
+                    astar->retain();
+                    astar->setupMap(entry.map);
+                    worker->astars.push_back(astar);
+                    
+                    auto dijkstra = dijkstra::PathFinding::create();
+                    dijkstra->retain();
+                    dijkstra->setupMap(entry.map);
+                    worker->dijkstras.push_back(dijkstra);
+                }
+                _workers.push_back(worker);
+            }
+            for (auto worker : _workers) {
+                worker->thread = std::thread(&PathServer::workerLoop, this, worker);
+            }
+            return true;
+        }
+        
+        void PathServer::serveConnection(int fd)
+        {
+            auto connection = std::make_shared<Connection>(fd);
+            {
+                std::lock_guard<std::mutex> lock(_connectionsMutex);
+                _connectionCount ++;
+                _connections.push_back(connection);
+            }
+            {
+                // registered before the check, stop() shut it down otherwise
+                std::lock_guard<std::mutex> lock(_mutex);
+                if(_stopping){
+                    shutdown(fd, SHUT_RD);
+                }
+            }
+            
+            FrameReader reader(fd);
+            std::vector<Pending> received;
+            const uint8_t* body = nullptr;
+            size_t size = 0;
+            
+            while (reader.readFrame(body, size)) {
+                Pending pending;
+                if(!decodeRequest(body, size, pending.request)){
+                    CCLOG("Path service: malformed request, connection closed");
+                    break;
+                }
+                pending.connection = connection;
+                pending.arrival = Clock::now();
+                received.push_back(std::move(pending));
+                
+                // the frames of one read are queued at once
+                if(reader.hasFrame() && received.size() < (size_t)_maxBatchSize){
+                    continue;
+                }
+                {
+                    std::lock_guard<std::mutex> lock(_mutex);
+                    for (auto& item : received) {
+                        _pending.push_back(std::move(item));
+                    }
+                }
+                _condition.notify_one();
+                _requestCount += received.size();
+                received.clear();
+            }
+            
+            // the socket is closed when the last response is sent
+            shutdown(fd, SHUT_RD);
+            connection.reset();
+            
+            std::lock_guard<std::mutex> lock(_connectionsMutex);
+            _connectionCount --;
+            _connections.erase(std::remove_if(_connections.begin(), _connections.end(),
+                                              [](const std::weak_ptr<Connection>& item) { return item.expired(); }),
+                               _connections.end());
+            _connectionsCondition.notify_all();
+        }
+        
+        bool PathServer::listen(const std::string& socketPath)
+        {
+            struct sockaddr_un address;
+            if(socketPath.size() >= sizeof(address.sun_path)){
+                return false;
+            }
+            memset(&address, 0, sizeof(address));
+            address.sun_family = AF_UNIX;
+            memcpy(address.sun_path, socketPath.c_str(), socketPath.size());
+            
+            int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+            if(fd < 0){
+                return false;
+            }
+            unlink(socketPath.c_str());
+            if(bind(fd, (struct sockaddr*)&address, sizeof(address)) != 0 || ::listen(fd, kListenBacklog) != 0){
+                CCLOG("Path service: can't listen on %s", socketPath.c_str());
+                close(fd);
+                return false;
+            }
+            
+            std::lock_guard<std::mutex> lock(_connectionsMutex);
+            _listenFd = fd;
+            _socketPath = socketPath;
+            return true;
+        }
+        
+        void PathServer::run()
+        {
+            int listenFd;
+            {
+                std::lock_guard<std::mutex> lock(_connectionsMutex);
+                listenFd = _listenFd;
+            }
+            CCASSERT(listenFd >= 0, "Call listen before run");
+            
+            while (true) {
+                int fd = accept(listenFd, nullptr, nullptr);
+                {
+                    std::lock_guard<std::mutex> lock(_mutex);
+                    if(_stopping){
+                        if(fd >= 0){
+                            close(fd);
+                        }
+                        break;
+                    }
+                }
+                if(fd < 0){
+                    if(errno != EINTR && errno != ECONNABORTED){
+                        // out of descriptors, let the connections finish
+                        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                    }
+                    continue;
+                }
+                std::thread(&PathServer::serveConnection, this, fd).detach();
+            }
+            
+            std::unique_lock<std::mutex> lock(_connectionsMutex);
+            _connectionsCondition.wait(lock, [this]() { return _connectionCount == 0; });
+            close(listenFd);
+            unlink(_socketPath.c_str());
+            _listenFd = -1;
+        }
+        
+        void PathServer::stop()
+        {
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                if(_stopping){
+                    return;
+                }
+                _stopping = true;
+            }
+            _condition.notify_all();
+            
+            {
+                // wake up accept and the reader threads
+                std::lock_guard<std::mutex> lock(_connectionsMutex);
+                if(_listenFd >= 0){
+                    shutdown(_listenFd, SHUT_RDWR);
+                }
+                for (auto& item : _connections) {
+                    if(auto connection = item.lock()){
+                        shutdown(connection->fd, SHUT_RD);
+                    }
+                }
+            }
+            
+            // the workers answer what was already received
+            for (auto worker : _workers) {
+                if(worker->thread.joinable()){
+                    worker->thread.join();
+                }
+            }
+        }
+        
+        bool PathServer::takeBatch(std::vector<Pending>& batch)
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            while (true) {
+                if(_pending.empty()){
+                    if(_stopping){
+                        return false;
+                    }
+                    _condition.wait(lock);
+                    continue;
+                }
+                
+                // wait for the requests arriving in the window of the oldest one
+                auto deadline = _pending.front().arrival + std::chrono::microseconds(_batchWindow);
+                if(!_stopping && _pending.size() < (size_t)_maxBatchSize && Clock::now() < deadline){
+                    _condition.wait_until(lock, deadline);
+                    continue;
+                }
+                break;
+            }
+            
+            size_t count = std::min(_pending.size(), (size_t)_maxBatchSize);
+            batch.clear();
+            std::move(_pending.begin(), _pending.begin() + count, std::back_inserter(batch));
+            _pending.erase(_pending.begin(), _pending.begin() + count);
+            bool more = !_pending.empty();
+            lock.unlock();
+            
+            if(more){
+                _condition.notify_one();
+            }
+            return true;
+        }
+        
+        void PathServer::workerLoop(Worker* worker)
+        {
+            std::vector<Pending> batch;
+            while (takeBatch(batch)) {
+                processBatch(worker, batch);
+            }
+        }
+        
+        void PathServer::processBatch(Worker* worker, std::vector<Pending>& batch)
+        {
+            _batchCount ++;
+            
+            // identical queries end up next to each other and are answered once
+            std::vector<size_t> order(batch.size());
+            for (size_t i = 0; i < order.size(); i ++) {
+                order[i] = i;
+            }
+            std::sort(order.begin(), order.end(), [&batch](size_t a, size_t b) {
+                return isQueryBefore(batch[a].request, batch[b].request);
+            });
+            
+            // one write per connection
+            std::vector<std::pair<Connection *, std::vector<uint8_t>>> outputs;
+            ServiceResponse response;
+            const ServiceRequest* previous = nullptr;
+            
+            for (auto idx : order) {
+                const Pending& pending = batch[idx];
+                if(previous == nullptr || !isSameQuery(*previous, pending.request)){
+                    answer(worker, pending.request, response);
+                    previous = &pending.request;
+                }
+                response.id = pending.request.id;
+                
+                Connection* connection = pending.connection.get();
+                auto output = std::find_if(outputs.begin(), outputs.end(),
+                                           [connection](const std::pair<Connection *, std::vector<uint8_t>>& item) {
+                                               return item.first == connection;
+                                           });
+                if(output == outputs.end()){
+                    outputs.push_back(std::make_pair(connection, std::vector<uint8_t>()));
+                    output = outputs.end() - 1;
+                }
+                encodeResponse(response, output->second);
+            }
+            
+            for (auto& output : outputs) {
+                std::lock_guard<std::mutex> lock(output.first->writeMutex);
+                // a closed peer only lose its own responses
+                writeAll(output.first->fd, output.second.data(), output.second.size());
+            }
+            
+            // release the connections before waiting for the next batch
+            batch.clear();
+        }
+        
+        void PathServer::answer(Worker* worker, const ServiceRequest& request, ServiceResponse& response)
+        {
+            response.type = request.type;
+            response.path.clear();
+            
+            auto ite = _mapIndexes.find(request.map);
+            if(ite == _mapIndexes.end()){
+                response.status = STATUS_UNKNOWN_MAP;
+                return;
+            }
+            int index = ite->second;
+            CollisionData* map = _maps[index].map;
+            
+            int width = map->getWidth();
+            int height = map->getHeight();
+            if(request.fromX < 0 || request.fromY < 0 || request.fromX >= width || request.fromY >= height ||
+               request.toX < 0 || request.toY < 0 || request.toX >= width || request.toY >= height ||
+               request.agentSize == 0){
+                response.status = STATUS_BAD_REQUEST;
+                return;
+            }
+            
+            if(request.type == REQUEST_LINE_OF_SIGHT){
+                bool free = map->isLineFree(request.fromX, request.fromY, request.toX, request.toY);
+                response.status = free ? STATUS_OK : STATUS_BLOCKED;
+                return;
+            }
+            if(request.type != REQUEST_PATH){
+                response.status = STATUS_BAD_REQUEST;
+                return;
+            }
+            
+            Vec2 from(request.fromX, request.fromY);
+            Vec2 to(request.toX, request.toY);
+            bool bidirectional = (request.flags & FLAG_BIDIRECTIONAL) != 0;
+            bool found;
+            
+            if(request.flags & FLAG_DIJKSTRA){
+                auto engine = worker->dijkstras[index];
+                engine->setAgentSize(request.agentSize);
+                engine->setBidirectional(bidirectional);
+                found = engine->getShortestPath(from, to, response.path);
+            }
+            else{
+                auto engine = worker->astars[index];
+                engine->setAgentSize(request.agentSize);
+                engine->setBidirectional(bidirectional);
+                found = engine->getShortestPath(from, to, response.path);
+            }
+            response.status = found ? STATUS_OK : STATUS_NO_PATH;
+        }
+    }
+}
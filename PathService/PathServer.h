@@ -0,0 +1,162 @@
+/****************************************************************************
+ Copyright (c) 2015 QuanNguyen
+ 
+ http://quannguyen.info
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+
+#ifndef __Funny_PathService__PathServer__
+#define __Funny_PathService__PathServer__
+
+#include "cocos2d.h"
+#include "CollisionData.h"
+#include "PathServiceProtocol.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+namespace pathfinding {
+    namespace service {
+        
+        /**
+         *  Headless path query service: the maps are loaded once and shared by the client processes
+         *  through a Unix domain socket (see PathServiceProtocol.h and PathClient).
+         *
+         *  Every connection has a reader thread which decode the requests; the workers wait for the
+         *  requests arriving close together (batch window) and take them as one batch, so a burst
+         *  cost one wake up, the identical requests of a batch are searched once and the responses
+         *  of a connection are sent with one write.
+         *  Every worker own its engines for every map, created by start().
+         *
+         *  The maps are read only once the server is started.
+         */
+        class PathServer
+        {
+        public:
+            PathServer();
+            virtual ~PathServer();
+            
+            /**
+             *  load a map before start like CollisionManager: a .cmap file written by
+             *  CollisionData::saveToFile is memory mapped, any other file is read as an image
+             *  @return true if the map was loaded
+             */
+            bool loadMap(const std::string& name, const std::string& fileName);
+            
+            /**
+             *  add a map before start, the server delete it
+             *  its clearance map is enabled for the requests of agents bigger than a tile
+             */
+            void addMap(const std::string& name, CollisionData* map);
+            
+            CollisionData* getMap(const std::string& name) const;
+            
+            /**
+             *  create the workers and their engines, call it on the main thread
+             *  @param workerCount 0 to use the number of cores - 1 (at least 1)
+             */
+            bool start(int workerCount = 0);
+            
+            /**
+             *  serve one connected socket until the peer close it, the server own the socket
+             *  thread safe, a test can call it with one end of a socketpair
+             */
+            void serveConnection(int fd);
+            
+            /**
+             *  bind the Unix domain socket, an old socket file at this path is removed
+             */
+            bool listen(const std::string& socketPath);
+            
+            /**
+             *  accept the connections until stop(), one thread per connection
+             */
+            void run();
+            
+            /**
+             *  thread safe: close the sockets, finish the workers and return from run and serveConnection
+             */
+            void stop();
+            
+            inline uint64_t getRequestCount() const {
+                return _requestCount.load();
+            }
+            
+            inline uint64_t getBatchCount() const {
+                return _batchCount.load();
+            }
+            
+        protected:
+            typedef std::chrono::steady_clock Clock;
+            
+            struct Connection;
+            struct Worker;
+            
+            struct Pending {
+                std::shared_ptr<Connection> connection;
+                ServiceRequest request;
+                Clock::time_point arrival;
+            };
+            
+            struct MapEntry {
+                std::string name;
+                CollisionData* map;
+            };
+            
+            void workerLoop(Worker* worker);
+            bool takeBatch(std::vector<Pending>& batch);
+            void processBatch(Worker* worker, std::vector<Pending>& batch);
+            void answer(Worker* worker, const ServiceRequest& request, ServiceResponse& response);
+            
+            std::vector<MapEntry> _maps;
+            std::unordered_map<std::string, int> _mapIndexes;
+            std::vector<Worker *> _workers;
+            
+            std::deque<Pending> _pending;
+            std::mutex _mutex;
+            std::condition_variable _condition;
+            bool _stopping;
+            
+            std::mutex _connectionsMutex;
+            std::condition_variable _connectionsCondition;
+            std::vector<std::weak_ptr<Connection>> _connections;
+            int _connectionCount;
+            int _listenFd;
+            std::string _socketPath;
+            
+            std::atomic<uint64_t> _requestCount;
+            std::atomic<uint64_t> _batchCount;
+            
+            /**
+             *  microseconds a worker wait for more requests after the first one of a batch, 0 to not wait
+             */
+            CC_SYNTHESIZE(int, _batchWindow, BatchWindow);
+            
+            CC_SYNTHESIZE(int, _maxBatchSize, MaxBatchSize);
+        };
+    }
+}
+
+#endif /* defined(__Funny_PathService__PathServer__) */
@@ -0,0 +1,95 @@
+/****************************************************************************
+ Copyright (c) 2015 QuanNguyen
+ 
+ http://quannguyen.info
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+
+#include "PathServer.h"
+
+#include <signal.h>
+
+using namespace pathfinding::service;
+
+/**
+ *  pathservice [-w workers] [-b batch window in microseconds] <socket> <name>=<map file> ...
+ *  pathservice --convert <image> <map file>
+ */
+int main(int argc, char** argv)
+{
+    if(argc == 4 && strcmp(argv[1], "--convert") == 0){
+        CollisionData map;
+        if(!map.initWithFile(argv[2]) || !map.saveToFile(argv[3])){
+            fprintf(stderr, "Can't convert %s\n", argv[2]);
+            return 1;
+        }
+        return 0;
+    }
+    
+    PathServer server;
+    int workers = 0;
+    int arg = 1;
+    for (; arg + 1 < argc && argv[arg][0] == '-'; arg += 2) {
+        if(strcmp(argv[arg], "-w") == 0){
+            workers = atoi(argv[arg + 1]);
+        }else if(strcmp(argv[arg], "-b") == 0){
+            server.setBatchWindow(atoi(argv[arg + 1]));
+        }
+    }
+    if(arg + 2 > argc){
+        fprintf(stderr, "usage: %s [-w workers] [-b batch window us] <socket> <name>=<map file> ...\n"
+                "       %s --convert <image> <map file>\n", argv[0], argv[0]);
+        return 1;
+    }
+    
+    std::string socketPath = argv[arg ++];
+    for (; arg < argc; arg ++) {
+        std::string map = argv[arg];
+        size_t split = map.find('=');
+        if(split == std::string::npos || !server.loadMap(map.substr(0, split), map.substr(split + 1))){
+            fprintf(stderr, "Can't load map %s\n", argv[arg]);
+            return 1;
+        }
+    }
+    
+    // the signals are only received by the thread waiting for them
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+    signal(SIGPIPE, SIG_IGN);
+    
+    if(!server.listen(socketPath) || !server.start(workers)){
+        fprintf(stderr, "Can't listen on %s\n", socketPath.c_str());
+        return 1;
+    }
+    
+    std::thread waiter([&server, &signals]() {
+        int received = 0;
+        sigwait(&signals, &received);
+        server.stop();
+    });
+    
+    // return once the waiter stopped the server
+    server.run();
+    waiter.join();
+    return 0;
+}
@@ -0,0 +1,221 @@
+/****************************************************************************
+ Copyright (c) 2015 QuanNguyen
+ 
+ http://quannguyen.info
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+
+#include "PathServiceProtocol.h"
+
+#include <errno.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace pathfinding {
+    namespace service {
+        
+        static const size_t kRequestHeaderSize = 24;
+        static const size_t kResponseHeaderSize = 8;
+        static const size_t kPathHeaderSize = 12;
+        static const size_t kReadSize = 64 * 1024;
+        
+#if defined(MSG_NOSIGNAL)
+        static const int kSendFlags = MSG_NOSIGNAL;
+#else
+        static const int kSendFlags = 0;
+#endif
+        
+        static inline void put16(std::vector<uint8_t>& out, uint16_t v)
+        {
+            out.push_back(v & 0xFF);
+            out.push_back(v >> 8);
+        }
+        
+        static inline void put32(std::vector<uint8_t>& out, uint32_t v)
+        {
+            out.push_back(v & 0xFF);
+            out.push_back((v >> 8) & 0xFF);
+            out.push_back((v >> 16) & 0xFF);
+            out.push_back(v >> 24);
+        }
+        
+        static inline void set32(std::vector<uint8_t>& out, size_t pos, uint32_t v)
+        {
+            out[pos] = v & 0xFF;
+            out[pos + 1] = (v >> 8) & 0xFF;
+            out[pos + 2] = (v >> 16) & 0xFF;
+            out[pos + 3] = v >> 24;
+        }
+        
+        static inline uint16_t get16(const uint8_t* p)
+        {
+            return (uint16_t)(p[0] | (p[1] << 8));
+        }
+        
+        static inline uint32_t get32(const uint8_t* p)
+        {
+            return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+        }
+        
+        void encodeRequest(const ServiceRequest& request, std::vector<uint8_t>& out)
+        {
+            CCASSERT(request.map.size() <= kMaxMapNameSize, "Map name too long");
+            
+            put32(out, (uint32_t)(kRequestHeaderSize + request.map.size()));
+            put32(out, request.id);
+            out.push_back(request.type);
+            out.push_back(request.flags);
+            out.push_back(request.agentSize);
+            out.push_back((uint8_t)request.map.size());
+            put32(out, request.fromX);
+            put32(out, request.fromY);
+            put32(out, request.toX);
+            put32(out, request.toY);
+            out.insert(out.end(), request.map.begin(), request.map.end());
+        }
+        
+        bool decodeRequest(const uint8_t* body, size_t size, ServiceRequest& request)
+        {
+            if(size < kRequestHeaderSize || size != kRequestHeaderSize + body[7]){
+                return false;
+            }
+            request.id = get32(body);
+            request.type = body[4];
+            request.flags = body[5];
+            request.agentSize = body[6];
+            request.fromX = (int32_t)get32(body + 8);
+            request.fromY = (int32_t)get32(body + 12);
+            request.toX = (int32_t)get32(body + 16);
+            request.toY = (int32_t)get32(body + 20);
+            request.map.assign((const char*)body + kRequestHeaderSize, body[7]);
+            return true;
+        }
+        
+        void encodeResponse(const ServiceResponse& response, std::vector<uint8_t>& out)
+        {
+            size_t start = out.size();
+            put32(out, 0);
+            put32(out, response.id);
+            out.push_back(response.type);
+            out.push_back(response.status);
+            put16(out, 0);
+            
+            if(response.type == REQUEST_PATH && response.status == STATUS_OK){
+                const PathBuffer& path = response.path;
+                put32(out, path.getStartX());
+                put32(out, path.getStartY());
+                put32(out, (uint32_t)path.getRunCount());
+                const uint16_t* runs = path.getRuns();
+                for (size_t i = 0; i < path.getRunCount(); i ++) {
+                    put16(out, runs[i]);
+                }
+            }
+            set32(out, start, (uint32_t)(out.size() - start - 4));
+        }
+        
+        bool decodeResponse(const uint8_t* body, size_t size, ServiceResponse& response)
+        {
+            if(size < kResponseHeaderSize){
+                return false;
+            }
+            response.id = get32(body);
+            response.type = body[4];
+            response.status = body[5];
+            response.path.clear();
+            
+            if(response.type != REQUEST_PATH || response.status != STATUS_OK){
+                return size == kResponseHeaderSize;
+            }
+            if(size < kResponseHeaderSize + kPathHeaderSize){
+                return false;
+            }
+            
+            const uint8_t* p = body + kResponseHeaderSize;
+            size_t runCount = get32(p + 8);
+            if(size != kResponseHeaderSize + kPathHeaderSize + runCount * 2){
+                return false;
+            }
+            
+            std::vector<uint16_t> runs(runCount);
+            for (size_t i = 0; i < runCount; i ++) {
+                runs[i] = get16(p + kPathHeaderSize + i * 2);
+            }
+            response.path.assign((int32_t)get32(p), (int32_t)get32(p + 4), runs.data(), runCount);
+            return true;
+        }
+        
+        bool writeAll(int fd, const uint8_t* data, size_t size)
+        {
+            while (size > 0) {
+                ssize_t n = send(fd, data, size, kSendFlags);
+                if(n < 0){
+                    if(errno == EINTR){
+                        continue;
+                    }
+                    return false;
+                }
+                data += n;
+                size -= n;
+            }
+            return true;
+        }
+        
+        bool FrameReader::hasFrame() const
+        {
+            if(_end - _begin < 4){
+                return false;
+            }
+            return _end - _begin - 4 >= get32(&_buffer[_begin]);
+        }
+        
+        bool FrameReader::readFrame(const uint8_t*& body, size_t& size)
+        {
+            while (!hasFrame()) {
+                if(_end - _begin >= 4 && get32(&_buffer[_begin]) > kMaxFrameSize){
+                    return false;
+                }
+                
+                // move the partial frame to the front, then make room for a full read
+                if(_begin > 0){
+                    std::copy(_buffer.begin() + _begin, _buffer.begin() + _end, _buffer.begin());
+                    _end -= _begin;
+                    _begin = 0;
+                }
+                if(_buffer.size() < _end + kReadSize){
+                    _buffer.resize(_end + kReadSize);
+                }
+                
+                ssize_t n = recv(_fd, &_buffer[_end], _buffer.size() - _end, 0);
+                if(n < 0 && errno == EINTR){
+                    continue;
+                }
+                if(n <= 0){
+                    return false;
+                }
+                _end += n;
+            }
+            
+            size = get32(&_buffer[_begin]);
+            body = _buffer.data() + _begin + 4;
+            _begin += 4 + size;
+            return true;
+        }
+    }
+}
@@ -0,0 +1,164 @@
+/****************************************************************************
+ Copyright (c) 2015 QuanNguyen
+ 
+ http://quannguyen.info
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+
+#ifndef __Funny_PathService__PathServiceProtocol__
+#define __Funny_PathService__PathServiceProtocol__
+
+#include "cocos2d.h"
+#include "PathBuffer.h"
+
+namespace pathfinding {
+    namespace service {
+        
+        /**
+         *  Binary protocol of the path service, every value little endian.
+         *
+         *  frame    : uint32 size of the body, body
+         *  request  : uint32 id, uint8 type, uint8 flags, uint8 agent size, uint8 map name size,
+         *             int32 from x, from y, to x, to y, map name
+         *  response : uint32 id, uint8 type, uint8 status, uint16 0,
+         *             then for a path found: int32 start x, start y, uint32 run count, uint16 runs (see PathBuffer)
+         *
+         *  The responses of a connection can come in any order, match them with the id.
+         */
+        
+        enum RequestType {
+            REQUEST_PATH = 1,
+            /** status OK if the line is free, STATUS_BLOCKED if not */
+            REQUEST_LINE_OF_SIGHT = 2
+        };
+        
+        enum RequestFlags {
+            /** search with dijkstra::PathFinding (8 directions) instead of Astar::PathFinding */
+            FLAG_DIJKSTRA = 1,
+            FLAG_BIDIRECTIONAL = 2
+        };
+        
+        enum ResponseStatus {
+            STATUS_OK = 0,
+            STATUS_NO_PATH = 1,
+            STATUS_BLOCKED = 2,
+            STATUS_UNKNOWN_MAP = 3,
+            STATUS_BAD_REQUEST = 4,
+            /** the connection was lost before the response */
+            STATUS_DISCONNECTED = 5
+        };
+        
+        static const size_t kMaxFrameSize = 1 << 20;
+        static const size_t kMaxMapNameSize = 255;
+        
+        struct ServiceRequest {
+            ServiceRequest() :
+            id(0),
+            type(REQUEST_PATH),
+            flags(0),
+            agentSize(1),
+            fromX(0),
+            fromY(0),
+            toX(0),
+            toY(0)
+            {
+            };
+            
+            uint32_t id;
+            uint8_t type;
+            uint8_t flags;
+            uint8_t agentSize;
+            std::string map;
+            int32_t fromX;
+            int32_t fromY;
+            int32_t toX;
+            int32_t toY;
+        };
+        
+        struct ServiceResponse {
+            ServiceResponse() :
+            id(0),
+            type(REQUEST_PATH),
+            status(STATUS_OK)
+            {
+            };
+            
+            uint32_t id;
+            uint8_t type;
+            uint8_t status;
+            
+            /** the path of a REQUEST_PATH with STATUS_OK */
+            PathBuffer path;
+        };
+        
+        /**
+         *  append the frame of the message to out
+         */
+        void encodeRequest(const ServiceRequest& request, std::vector<uint8_t>& out);
+        void encodeResponse(const ServiceResponse& response, std::vector<uint8_t>& out);
+        
+        /**
+         *  decode the body of a frame
+         *  @return false if the body is malformed
+         */
+        bool decodeRequest(const uint8_t* body, size_t size, ServiceRequest& request);
+        bool decodeResponse(const uint8_t* body, size_t size, ServiceResponse& response);
+        
+        /**
+         *  write everything, retry on EINTR and partial writes
+         *  @return false if the socket is closed
+         */
+        bool writeAll(int fd, const uint8_t* data, size_t size);
+        
+        /**
+         *  split the stream of a socket in frames, one read can bring many frames
+         */
+        class FrameReader
+        {
+        public:
+            FrameReader(int fd) :
+            _fd(fd),
+            _begin(0),
+            _end(0)
+            {
+            };
+            
+            /**
+             *  return the next frame, read the socket only when no full frame is buffered
+             *  the body stay valid until the next call
+             *  @return false at the end of the stream, on error or on a frame bigger than kMaxFrameSize
+             */
+            bool readFrame(const uint8_t*& body, size_t& size);
+            
+            /**
+             *  @return true if another frame is already buffered, readFrame won't block
+             */
+            bool hasFrame() const;
+            
+        protected:
+            int _fd;
+            std::vector<uint8_t> _buffer;
+            size_t _begin;
+            size_t _end;
+        };
+    }
+}
+
+#endif /* defined(__Funny_PathService__PathServiceProtocol__) */
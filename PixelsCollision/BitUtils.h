@@ -0,0 +1,91 @@
+/****************************************************************************
+ Copyright (c) 2015 QuanNguyen
+ 
+ http://quannguyen.info
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+
+#ifndef __Funny__BitUtils__
+#define __Funny__BitUtils__
+
+#include <stdint.h>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+/**
+ *  Bit counts of a 64 bits word with the compiler intrinsics, GCC/Clang builtins or MSVC ones.
+ *  The zero counts are undefined for 0, like the instructions.
+ */
+
+static inline int countBits64(uint64_t v)
+{
+#if defined(_MSC_VER) && defined(_M_X64)
+    return (int)__popcnt64(v);
+#elif defined(_MSC_VER)
+    v = v - ((v >> 1) & 0x5555555555555555ULL);
+    v = (v & 0x3333333333333333ULL) + ((v >> 2) & 0x3333333333333333ULL);
+    v = (v + (v >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    return (int)((v * 0x0101010101010101ULL) >> 56);
+#else
+    return __builtin_popcountll((unsigned long long)v);
+#endif
+}
+
+static inline int countLeadingZeros64(uint64_t v)
+{
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_ARM64))
+    unsigned long index;
+    _BitScanReverse64(&index, v);
+    return 63 - (int)index;
+#elif defined(_MSC_VER)
+    unsigned long index;
+    if(v >> 32){
+        _BitScanReverse(&index, (unsigned long)(v >> 32));
+        return 31 - (int)index;
+    }
+    _BitScanReverse(&index, (unsigned long)v);
+    return 63 - (int)index;
+#else
+    return __builtin_clzll((unsigned long long)v);
+#endif
+}
+
+static inline int countTrailingZeros64(uint64_t v)
+{
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_ARM64))
+    unsigned long index;
+    _BitScanForward64(&index, v);
+    return (int)index;
+#elif defined(_MSC_VER)
+    unsigned long index;
+    if((uint32_t)v){
+        _BitScanForward(&index, (unsigned long)v);
+        return (int)index;
+    }
+    _BitScanForward(&index, (unsigned long)(v >> 32));
+    return 32 + (int)index;
+#else
+    return __builtin_ctzll((unsigned long long)v);
+#endif
+}
+
+#endif /* defined(__Funny__BitUtils__) */
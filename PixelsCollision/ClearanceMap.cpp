@@ -0,0 +1,109 @@
+/****************************************************************************
+ Copyright (c) 2015 QuanNguyen
+ 
+ http://quannguyen.info
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+
+#include "ClearanceMap.h"
+
+USING_NS_CC;
+
+bool ClearanceMap::initWithMap(const CollisionData* map, int maxClearance)
+{
+    _width = map->getWidth();
+    _height = map->getHeight();
+    _maxClearance = std::max(1, std::min(255, maxClearance));
+    _clearance.assign((size_t)_width * _height, 0);
+    
+    // clearance = min(horizontal run, vertical run, clearance of the top right neighbour + 1)
+    // row y only need row y + 1, so every loop over x below is branch free and vectorizable
+    std::vector<uint8_t> free(_width);
+    std::vector<uint8_t> hrun(_width);
+    std::vector<uint8_t> vrun(_width + 1, 0);
+    std::vector<uint8_t> above(_width + 1, 0);
+    uint8_t cap = _maxClearance;
+    
+    for (int y = _height - 1; y >= 0; y --) {
+        ssize_t rowPos = (ssize_t)y * _width;
+        for (int x = 0; x < _width; x += CollisionData::kMaskBits) {
+            MaskType bits = map->readBits(rowPos + x);
+            int n = std::min(CollisionData::kMaskBits, _width - x);
+            for (int i = 0; i < n; i ++) {
+                free[x + i] = (bits >> (CollisionData::kMaskBits - 1 - i)) & 1 ? 0xFF : 0;
+            }
+        }
+        
+        // pass 1: free run to the right
+        uint8_t run = 0;
+        for (int x = _width - 1; x >= 0; x --) {
+            run = free[x] & (uint8_t)std::min<int>(run + 1, cap);
+            hrun[x] = run;
+        }
+        
+        // pass 2: free run to the top and the square recurrence
+        uint8_t* out = &_clearance[rowPos];
+        for (int x = 0; x < _width; x ++) {
+            vrun[x] = free[x] & (uint8_t)std::min<int>(vrun[x] + 1, cap);
+            uint8_t c = std::min<uint8_t>(std::min(hrun[x], vrun[x]), (uint8_t)std::min<int>(above[x + 1] + 1, cap));
+            out[x] = c;
+        }
+        std::copy(out, out + _width, above.begin());
+    }
+    
+    return true;
+}
+
+void ClearanceMap::update(const CollisionData* map, int x, int y)
+{
+    updateRect(map, x, y, 1, 1);
+}
+
+void ClearanceMap::updateRect(const CollisionData* map, int x, int y, int w, int h)
+{
+    // only the tiles whose square can reach the rectangle are affected, walk them from its top right corner
+    // to the bottom left with clearance = 1 + min(right, top, top right), below the rectangle a row with no
+    // change stop the propagation
+    int x1 = std::min(_width, x + w) - 1;
+    int y1 = std::min(_height, y + h) - 1;
+    int left = std::max(0, x - _maxClearance + 1);
+    int bottom = std::max(0, y - _maxClearance + 1);
+    
+    for (int row = y1; row >= bottom; row --) {
+        bool changed = false;
+        for (int col = x1; col >= left; col --) {
+            int c = 0;
+            if(!map->haveCollisionAtCoord(col, row)){
+                int right = (col + 1 < _width) ? getClearance(col + 1, row) : 0;
+                int top = (row + 1 < _height) ? getClearance(col, row + 1) : 0;
+                int topRight = (col + 1 < _width && row + 1 < _height) ? getClearance(col + 1, row + 1) : 0;
+                c = std::min(_maxClearance, 1 + std::min(right, std::min(top, topRight)));
+            }
+            uint8_t& v = _clearance[col + (size_t)row * _width];
+            if(v != c){
+                v = c;
+                changed = true;
+            }
+        }
+        if(!changed && row <= y){
+            break;
+        }
+    }
+}
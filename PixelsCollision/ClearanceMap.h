@@ -0,0 +1,79 @@
+/****************************************************************************
+ Copyright (c) 2015 QuanNguyen
+ 
+ http://quannguyen.info
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+
+#ifndef __Funny__ClearanceMap__
+#define __Funny__ClearanceMap__
+
+#include "CollisionData.h"
+
+/**
+ *  Clearance of every tile: size of the largest free square with its bottom left corner on the tile
+ *  (the square cover [x, x + size) * [y, y + size)). An agent of size s can stand on a tile
+ *  when its clearance >= s, one lookup per expansion.
+ *
+ *  Built with 2 row sweeps which the compiler can vectorize, updated locally
+ *  by CollisionData::setCollisionInfo. 1 byte per tile.
+ */
+class ClearanceMap
+{
+public:
+    ClearanceMap() :
+    _width(0),
+    _height(0),
+    _maxClearance(0)
+    {
+    };
+    
+    virtual ~ClearanceMap()
+    {
+    }
+    
+    /**
+     *  @param maxClearance values are clamped to it (<= 255), a lower value make the local update cheaper
+     */
+    bool initWithMap(const CollisionData* map, int maxClearance = 255);
+    
+    /**
+     *  a tile changed, recompute the tiles below and on the left of it
+     */
+    void update(const CollisionData* map, int x, int y);
+    
+    /**
+     *  the tiles of the rectangle changed, same as update on each of them with one walk
+     */
+    void updateRect(const CollisionData* map, int x, int y, int w, int h);
+    
+    inline int getClearance(int x, int y) const {
+        return _clearance[x + (size_t)y * _width];
+    }
+    
+protected:
+    std::vector<uint8_t> _clearance;
+    
+    CC_SYNTHESIZE_READONLY(int, _width, Width);
+    CC_SYNTHESIZE_READONLY(int, _height, Height);
+    CC_SYNTHESIZE_READONLY(int, _maxClearance, MaxClearance);
+};
+
+#endif /* defined(__Funny__ClearanceMap__) */
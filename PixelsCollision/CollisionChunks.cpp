@@ -0,0 +1,289 @@
+/****************************************************************************
+ Copyright (c) 2015 QuanNguyen
+ 
+ http://quannguyen.info
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+
+#include "CollisionChunks.h"
+#include "BitUtils.h"
+
+USING_NS_CC;
+
+#define CHUNK_ROWS_8(v) v, v, v, v, v, v, v, v
+
+const int CollisionChunks::kChunkShift;
+const int CollisionChunks::kChunkSize;
+const int CollisionChunks::kPageShift;
+const int CollisionChunks::kPageSize;
+
+uint64_t CollisionChunks::kFreeRows[kChunkSize] = {
+    CHUNK_ROWS_8(~0ULL), CHUNK_ROWS_8(~0ULL), CHUNK_ROWS_8(~0ULL), CHUNK_ROWS_8(~0ULL),
+    CHUNK_ROWS_8(~0ULL), CHUNK_ROWS_8(~0ULL), CHUNK_ROWS_8(~0ULL), CHUNK_ROWS_8(~0ULL)
+};
+uint64_t CollisionChunks::kBlockedRows[kChunkSize];
+uint64_t CollisionChunks::kUnloadedRows[kChunkSize];
+
+CollisionChunks::~CollisionChunks()
+{
+    for (auto page : _pages) {
+        if(page){
+            for (auto rows : page->chunks) {
+                if(!isShared(rows)){
+                    delete[] rows;
+                }
+            }
+            delete page;
+        }
+    }
+}
+
+bool CollisionChunks::initWithSize(int width, int height, bool loaded)
+{
+    _width = width;
+    _height = height;
+    _chunksX = (width + kChunkSize - 1) >> kChunkShift;
+    _chunksY = (height + kChunkSize - 1) >> kChunkShift;
+    _pagesX = (_chunksX + kPageSize - 1) >> kPageShift;
+    int pagesY = (_chunksY + kPageSize - 1) >> kPageShift;
+    _pages.assign((size_t)_pagesX * pagesY, nullptr);
+    _fillRows = loaded ? kFreeRows : kUnloadedRows;
+    return true;
+}
+
+CollisionChunks::Page* CollisionChunks::getPage(int cx, int cy)
+{
+    Page*& page = _pages[(size_t)(cy >> kPageShift) * _pagesX + (cx >> kPageShift)];
+    if(page == nullptr){
+        page = new Page();
+        std::fill(page->chunks, page->chunks + kPageSize * kPageSize, _fillRows);
+        std::fill(page->modified, page->modified + kPageSize * kPageSize / 64, 0);
+    }
+    return page;
+}
+
+void CollisionChunks::setChunk(Page* page, int slot, uint64_t* rows)
+{
+    uint64_t*& chunk = page->chunks[slot];
+    if(!isShared(chunk)){
+        delete[] chunk;
+        _denseCount --;
+    }
+    if(!isShared(rows)){
+        _denseCount ++;
+    }
+    chunk = rows;
+}
+
+CollisionData::ChunkState CollisionChunks::getState(int cx, int cy) const
+{
+    const uint64_t* rows = getRows(cx, cy);
+    if(rows == kFreeRows){
+        return CollisionData::CHUNK_FREE;
+    }
+    if(rows == kBlockedRows){
+        return CollisionData::CHUNK_BLOCKED;
+    }
+    if(rows == kUnloadedRows){
+        return CollisionData::CHUNK_UNLOADED;
+    }
+    return CollisionData::CHUNK_DENSE;
+}
+
+uint64_t CollisionChunks::readRow(int x, int y) const
+{
+    int cx = x >> kChunkShift;
+    int cy = y >> kChunkShift;
+    int shift = x & (kChunkSize - 1);
+    int row = y & (kChunkSize - 1);
+    
+    uint64_t v = getRows(cx, cy)[row] << shift;
+    if(shift != 0 && cx + 1 < _chunksX){
+        v |= getRows(cx + 1, cy)[row] >> (kChunkSize - shift);
+    }
+    return v;
+}
+
+uint64_t* CollisionChunks::getUniformRows(int cx, int cy, const uint64_t* rows) const
+{
+    uint64_t mask = getColumnMask(cx);
+    int count = getRowCount(cy);
+    bool free = true;
+    bool blocked = true;
+    for (int r = 0; r < count && (free || blocked); r ++) {
+        uint64_t v = rows[r] & mask;
+        free = free && v == mask;
+        blocked = blocked && v == 0;
+    }
+    return free ? kFreeRows : (blocked ? kBlockedRows : nullptr);
+}
+
+bool CollisionChunks::setCollision(int x, int y, bool coli)
+{
+    int cx = x >> kChunkShift;
+    int cy = y >> kChunkShift;
+    const uint64_t* current = getRows(cx, cy);
+    uint64_t bit = (uint64_t)1 << (kChunkSize - 1 - (x & (kChunkSize - 1)));
+    int row = y & (kChunkSize - 1);
+    
+    if(current == kUnloadedRows || ((current[row] & bit) == 0) == coli){
+        return false;
+    }
+    
+    Page* page = getPage(cx, cy);
+    int slot = ((cy & (kPageSize - 1)) << kPageShift) | (cx & (kPageSize - 1));
+    page->modified[slot / 64] |= (uint64_t)1 << (slot % 64);
+    
+    uint64_t* rows = page->chunks[slot];
+    if(isShared(rows)){
+        // copy on write of the uniform chunk
+        uint64_t* dense = new uint64_t[kChunkSize];
+        std::copy(rows, rows + kChunkSize, dense);
+        setChunk(page, slot, dense);
+        rows = dense;
+    }
+    rows[row] ^= bit;
+    
+    // the chunk can only become uniform when its row does
+    uint64_t mask = getColumnMask(cx);
+    uint64_t v = rows[row] & mask;
+    if(v == 0 || v == mask){
+        uint64_t* uniform = getUniformRows(cx, cy, rows);
+        if(uniform){
+            setChunk(page, slot, uniform);
+        }
+    }
+    return true;
+}
+
+uint64_t CollisionChunks::writeRow(int cx, int y, uint64_t bits, uint64_t mask)
+{
+    int cy = y >> kChunkShift;
+    int row = y & (kChunkSize - 1);
+    const uint64_t* current = getRows(cx, cy);
+    uint64_t changed = (current[row] ^ bits) & mask;
+    
+    if(current == kUnloadedRows || changed == 0){
+        return 0;
+    }
+    
+    Page* page = getPage(cx, cy);
+    int slot = ((cy & (kPageSize - 1)) << kPageShift) | (cx & (kPageSize - 1));
+    page->modified[slot / 64] |= (uint64_t)1 << (slot % 64);
+    
+    uint64_t* rows = page->chunks[slot];
+    if(isShared(rows)){
+        uint64_t* dense = new uint64_t[kChunkSize];
+        std::copy(rows, rows + kChunkSize, dense);
+        setChunk(page, slot, dense);
+        rows = dense;
+    }
+    rows[row] ^= changed;
+    
+    uint64_t columns = getColumnMask(cx);
+    uint64_t v = rows[row] & columns;
+    if(v == 0 || v == columns){
+        uint64_t* uniform = getUniformRows(cx, cy, rows);
+        if(uniform){
+            setChunk(page, slot, uniform);
+        }
+    }
+    return changed;
+}
+
+void CollisionChunks::setRows(int cx, int cy, const uint64_t* rows)
+{
+    Page* page = getPage(cx, cy);
+    int slot = ((cy & (kPageSize - 1)) << kPageShift) | (cx & (kPageSize - 1));
+    page->modified[slot / 64] &= ~((uint64_t)1 << (slot % 64));
+    
+    uint64_t* uniform = getUniformRows(cx, cy, rows);
+    if(uniform){
+        setChunk(page, slot, uniform);
+        return;
+    }
+    
+    uint64_t* dense = page->chunks[slot];
+    if(isShared(dense)){
+        dense = new uint64_t[kChunkSize];
+        setChunk(page, slot, dense);
+    }
+    std::copy(rows, rows + kChunkSize, dense);
+}
+
+void CollisionChunks::unload(int cx, int cy)
+{
+    Page* page = getPage(cx, cy);
+    int slot = ((cy & (kPageSize - 1)) << kPageShift) | (cx & (kPageSize - 1));
+    page->modified[slot / 64] &= ~((uint64_t)1 << (slot % 64));
+    setChunk(page, slot, kUnloadedRows);
+}
+
+bool CollisionChunks::isModified(int cx, int cy) const
+{
+    const Page* page = _pages[(size_t)(cy >> kPageShift) * _pagesX + (cx >> kPageShift)];
+    int slot = ((cy & (kPageSize - 1)) << kPageShift) | (cx & (kPageSize - 1));
+    return page && ((page->modified[slot / 64] >> (slot % 64)) & 1);
+}
+
+int CollisionChunks::countCollisionInRect(int x, int y, int w, int h) const
+{
+    int count = 0;
+    int x1 = x + w;
+    int y1 = y + h;
+    
+    for (int cy = y >> kChunkShift; cy <= (y1 - 1) >> kChunkShift; cy ++) {
+        int top = std::max(y, cy << kChunkShift);
+        int bottom = std::min(y1, (cy + 1) << kChunkShift);
+        
+        for (int cx = x >> kChunkShift; cx <= (x1 - 1) >> kChunkShift; cx ++) {
+            int left = std::max(x, cx << kChunkShift);
+            int right = std::min(x1, (cx + 1) << kChunkShift);
+            const uint64_t* rows = getRows(cx, cy);
+            
+            if(rows == kFreeRows){
+                continue;
+            }
+            if(rows == kBlockedRows || rows == kUnloadedRows){
+                count += (right - left) * (bottom - top);
+                continue;
+            }
+            
+            // the columns of the rectangle in this chunk
+            int n = right - left;
+            uint64_t mask = (n >= kChunkSize ? ~(uint64_t)0 : ~(~(uint64_t)0 >> n)) >> (left & (kChunkSize - 1));
+            for (int row = top; row < bottom; row ++) {
+                count += n - countBits64(rows[row & (kChunkSize - 1)] & mask);
+            }
+        }
+    }
+    return count;
+}
+
+size_t CollisionChunks::getMemorySize() const
+{
+    size_t size = sizeof(*this) + _pages.capacity() * sizeof(Page *);
+    for (auto page : _pages) {
+        if(page){
+            size += sizeof(Page);
+        }
+    }
+    return size + _denseCount * kChunkSize * sizeof(uint64_t);
+}
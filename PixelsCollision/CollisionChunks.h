@@ -0,0 +1,206 @@
+/****************************************************************************
+ Copyright (c) 2015 QuanNguyen
+ 
+ http://quannguyen.info
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+
+#ifndef __Funny__CollisionChunks__
+#define __Funny__CollisionChunks__
+
+#include "CollisionData.h"
+
+/**
+ *  Give the tiles of the chunks of a CollisionData streamed in and out, see CollisionData::loadChunks
+ */
+class CollisionChunkProvider
+{
+public:
+    virtual ~CollisionChunkProvider() {};
+    
+    /**
+     *  fill the 64 rows of chunk (cx, cy): bit 63 - x % 64 of rows[y % 64] set = no collision
+     *  @return false if the chunk is not available, it stay unloaded
+     */
+    virtual bool loadChunk(int cx, int cy, uint64_t* rows) = 0;
+    
+    /**
+     *  the chunk is dropped, rows are its tiles
+     *  @param modified true if setCollisionInfo changed it since its load
+     */
+    virtual void unloadChunk(int cx, int cy, const uint64_t* rows, bool modified) {};
+};
+
+/**
+ *  Sparse storage of the tiles for CollisionData::LAYOUT_CHUNKED
+ *
+ *  The map is cut in 64x64 chunks: a chunk all free, all blocked or not loaded is a pointer to
+ *  shared rows and take no memory, the others own 64 rows of 64 bits (512 bytes).
+ *  The chunks are reached through pages of 32x32 chunk pointers, a page is only allocated once
+ *  one of its chunks differ from the initial state.
+ *
+ *  Built and kept up to date by CollisionData.
+ */
+class CollisionChunks
+{
+public:
+    static const int kChunkShift = 6;
+    static const int kChunkSize = 1 << kChunkShift;
+    static const int kPageShift = 5;
+    static const int kPageSize = 1 << kPageShift;
+    
+    CollisionChunks() :
+    _chunksX(0),
+    _chunksY(0),
+    _pagesX(0),
+    _denseCount(0),
+    _fillRows(nullptr),
+    _width(0),
+    _height(0)
+    {
+    };
+    
+    virtual ~CollisionChunks();
+    
+    /**
+     *  @param loaded true for all the chunks free, false for all the chunks unloaded
+     */
+    bool initWithSize(int width, int height, bool loaded);
+    
+    /**
+     *  rows of the chunk, 64 bits per row, first tile in the highest bit, bit set = no collision
+     */
+    inline const uint64_t* getRows(int cx, int cy) const {
+        const Page* page = _pages[(size_t)(cy >> kPageShift) * _pagesX + (cx >> kPageShift)];
+        return page ? page->chunks[((cy & (kPageSize - 1)) << kPageShift) | (cx & (kPageSize - 1))] : _fillRows;
+    }
+    
+    /**
+     *  the tile must be in the map, an unloaded tile have collision
+     */
+    inline bool haveCollision(int x, int y) const {
+        uint64_t row = getRows(x >> kChunkShift, y >> kChunkShift)[y & (kChunkSize - 1)];
+        return ((row >> (kChunkSize - 1 - (x & (kChunkSize - 1)))) & 1) == 0;
+    }
+    
+    CollisionData::ChunkState getState(int cx, int cy) const;
+    
+    /**
+     *  64 tiles of row y starting at x, first tile in the highest bit, 0 after the last chunk
+     */
+    uint64_t readRow(int x, int y) const;
+    
+    /**
+     *  change a tile of a loaded chunk
+     *  @return true if it changed
+     */
+    bool setCollision(int x, int y, bool coli);
+    
+    /**
+     *  replace the tiles of row y of chunk cx whose bit is set in mask by the ones of bits
+     *  @return the changed bits, 0 if the chunk is not loaded
+     */
+    uint64_t writeRow(int cx, int y, uint64_t bits, uint64_t mask);
+    
+    /**
+     *  replace the tiles of a chunk, it is loaded after
+     */
+    void setRows(int cx, int cy, const uint64_t* rows);
+    
+    /**
+     *  forget the tiles of a chunk, they have collision until setRows
+     */
+    void unload(int cx, int cy);
+    
+    /**
+     *  true if setCollision changed the chunk since its last setRows
+     */
+    bool isModified(int cx, int cy) const;
+    
+    /**
+     *  number of collision tiles in the rectangle, which must be in the map
+     *  the uniform chunks are counted without reading them
+     */
+    int countCollisionInRect(int x, int y, int w, int h) const;
+    
+    /**
+     *  @return bytes used by the pages and the chunks
+     */
+    size_t getMemorySize() const;
+    
+    inline int getChunksX() const {
+        return _chunksX;
+    }
+    
+    inline int getChunksY() const {
+        return _chunksY;
+    }
+    
+    inline size_t getDenseCount() const {
+        return _denseCount;
+    }
+    
+protected:
+    struct Page {
+        uint64_t* chunks[kPageSize * kPageSize];
+        uint64_t modified[kPageSize * kPageSize / 64];
+    };
+    
+    // the rows shared by the uniform chunks, never written
+    static uint64_t kFreeRows[kChunkSize];
+    static uint64_t kBlockedRows[kChunkSize];
+    static uint64_t kUnloadedRows[kChunkSize];
+    
+    std::vector<Page *> _pages;
+    int _chunksX;
+    int _chunksY;
+    int _pagesX;
+    size_t _denseCount;
+    uint64_t* _fillRows;
+    
+    Page* getPage(int cx, int cy);
+    void setChunk(Page* page, int slot, uint64_t* rows);
+    
+    /**
+     *  @return the shared rows if the tiles of the chunk inside of the map are all the same, nullptr if not
+     */
+    uint64_t* getUniformRows(int cx, int cy, const uint64_t* rows) const;
+    
+    /**
+     *  mask of the tiles of a chunk row inside of the map
+     */
+    inline uint64_t getColumnMask(int cx) const {
+        int n = std::min(kChunkSize, (int)_width - cx * kChunkSize);
+        return n >= kChunkSize ? ~(uint64_t)0 : ~(~(uint64_t)0 >> n);
+    }
+    
+    inline int getRowCount(int cy) const {
+        return std::min(kChunkSize, (int)_height - cy * kChunkSize);
+    }
+    
+    inline bool isShared(const uint64_t* rows) const {
+        return rows == kFreeRows || rows == kBlockedRows || rows == kUnloadedRows;
+    }
+    
+    CC_SYNTHESIZE_READONLY(int, _width, Width);
+    CC_SYNTHESIZE_READONLY(int, _height, Height);
+};
+
+#endif /* defined(__Funny__CollisionChunks__) */
@@ -23,20 +23,168 @@
  ****************************************************************************/
 
 #include "CollisionData.h"
+#include "OccupancyIndex.h"
+#include "ClearanceMap.h"
+#include "CollisionChunks.h"
+#include "CollisionMask.h"
+#include "BitUtils.h"
+#include <chrono>
+
+#if !defined(_WIN32)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
 
 USING_NS_CC;
 
 static int kMaskSize = sizeof(MaskType)*8;
 
+const int CollisionData::kMaskBits;
+const unsigned char CollisionData::kAlphaThreshold;
+
+// batch queries are bucketed by map region only when the map is much bigger than the cache
+static const size_t kBatchBucketMinCount = 4096;
+static const size_t kBatchBucketMinMapBytes = 64 * 1024 * 1024;
+static const size_t kBatchBucketTiles = 32 * 1024;
+
+// header of the files of saveToFile, the words follow it and stay 8 bytes aligned
+struct MapFileHeader {
+    char magic[4];
+    uint32_t formatVersion;
+    uint32_t maskBits;
+    uint32_t width;
+    uint32_t height;
+    uint32_t reserved;
+    uint64_t wordCount;
+};
+
+static const char kMapFileMagic[4] = {'C', 'M', 'A', 'P'};
+static const uint32_t kMapFileVersion = 1;
+static const std::string kMapFileExtension = ".cmap";
+
+/**
+ *  64 pixels of row y of the mask starting at column x (can be outside of the mask), first in the highest bit
+ *  without mask every pixel is solid
+ */
+static inline uint64_t readSolidBits(const CollisionMask* mask, int y, int x)
+{
+    if(!mask){
+        return ~(uint64_t)0;
+    }
+    
+    const MaskType* row = mask->getRow(y);
+    int words = mask->getWordsPerRow();
+    int first = (x >= 0) ? x / kMaskSize : -((kMaskSize - 1 - x) / kMaskSize);
+    int shift = x - first * kMaskSize;
+    
+    uint64_t v = 0;
+    for (int k = 0; k <= 64 / kMaskSize; k ++) {
+        int idx = first + k;
+        if(idx < 0 || idx >= words){
+            continue;
+        }
+        // offset from the highest bit of the element highest bit
+        int pos = k * kMaskSize - shift;
+        uint64_t w = (uint64_t)row[idx] << (64 - kMaskSize);
+        if(pos < 0){
+            v |= w << -pos;
+        }else if(pos < 64){
+            v |= w >> pos;
+        }
+    }
+    return v;
+}
+
+/**
+ *  new free bits of the tiles of range (bit set = free) under solid
+ */
+static inline uint64_t applyStamp(uint64_t free, uint64_t solid, uint64_t range, CollisionData::StampOp op)
+{
+    switch (op) {
+        case CollisionData::STAMP_SET:
+            return (free & ~range) | (~solid & range);
+        case CollisionData::STAMP_CLEAR:
+            return free | (solid & range);
+        case CollisionData::STAMP_OR:
+            return free & ~(solid & range);
+        case CollisionData::STAMP_AND:
+            return free | (~solid & range);
+    }
+    return free;
+}
+
+CollisionData::~CollisionData()
+{
+    // copied, a listener may remove itself
+    auto listeners = _listeners;
+    for (auto listener : listeners) {
+        listener->onCollisionDataDestroyed(this);
+    }
+    
+    releaseMap();
+    CC_SAFE_DELETE_ARRAY(_blocks);
+    CC_SAFE_DELETE(_chunks);
+    CC_SAFE_DELETE(_occupancy);
+    CC_SAFE_DELETE(_clearance);
+}
+
+void CollisionData::resetMap()
+{
+    releaseMap();
+    CC_SAFE_DELETE_ARRAY(_blocks);
+    CC_SAFE_DELETE(_chunks);
+    CC_SAFE_DELETE(_occupancy);
+    CC_SAFE_DELETE(_clearance);
+    _version ++;
+    _wordCount = 0;
+    _blocksX = (_width + 7) / 8;
+    _blocksY = (_height + 7) / 8;
+}
+
+void CollisionData::allocateMap()
+{
+    resetMap();
+    
+    //calculate how many elemment need, one more so readBits can always read the next element
+    _wordCount = (ssize_t)_width * _height / kMaskSize + 2;
+    _map = new MaskType[_wordCount]();
+}
+
+void CollisionData::releaseMap()
+{
+    if(_mappedData){
+#if !defined(_WIN32)
+        munmap(_mappedData, _mappedSize);
+#endif
+        _mappedData = nullptr;
+        _mappedSize = 0;
+        _map = nullptr;
+    }
+    CC_SAFE_DELETE_ARRAY(_map);
+}
+
 bool CollisionData::initWithSize(int w, int h)
 {
     _width = w;
     _height = h;
     
-    //calculate how many elemment need
-    int totalBitNeed = _width*_height;
-    totalBitNeed = (floor(totalBitNeed/(float)kMaskSize) + 1)*kMaskSize;
-    _map = new MaskType[totalBitNeed];
+    if(_layout == LAYOUT_CHUNKED){
+        // all the chunks are the shared free one
+        resetMap();
+        _chunks = new CollisionChunks();
+        return _chunks->initWithSize(w, h, true);
+    }
+    
+    // the tiles are written row major then converted
+    Layout layout = _layout;
+    _layout = LAYOUT_ROW_MAJOR;
+    allocateMap();
     
     int count = 0;
     MaskType c = 0;
@@ -47,7 +195,7 @@ bool CollisionData::initWithSize(int w, int h)
         for (int x = 0; x < _width; x++)
         {
             //can move
-            MaskType mask = 1 << (kMaskSize - 1 - count);
+            MaskType mask = (MaskType)1 << (kMaskSize - 1 - count);
             c |= mask;
             
             count ++;
@@ -69,9 +217,23 @@ bool CollisionData::initWithSize(int w, int h)
         count = 0;
     }
     
+    setLayout(layout);
     return true;
 }
 
+bool CollisionData::initWithChunkProvider(int width, int height, CollisionChunkProvider* provider)
+{
+    CCASSERT(provider, "Provider must be not null");
+    
+    _width = width;
+    _height = height;
+    _layout = LAYOUT_CHUNKED;
+    _chunkProvider = provider;
+    resetMap();
+    _chunks = new CollisionChunks();
+    return _chunks->initWithSize(width, height, false);
+}
+
 bool CollisionData::initWithFile(const std::string& fileName)
 {
     CCLOG("mask size = %d", kMaskSize);
@@ -82,6 +244,11 @@ bool CollisionData::initWithFile(const std::string& fileName)
     _width = img->getWidth();
     _height = img->getHeight();
     
+    // the tiles are written row major then converted
+    Layout layout = _layout;
+    _layout = LAYOUT_ROW_MAJOR;
+    allocateMap();
+    
     int count = 0;
     MaskType c = 0;
     unsigned int idx = 0;
@@ -96,10 +263,10 @@ bool CollisionData::initWithFile(const std::string& fileName)
             // You can see/change pixels' RGBA value(0-255) here !
             unsigned char a = *(pixel + 3);
             
-            if (a < 10)
+            if (a < kAlphaThreshold)
             {
                 //can move
-                MaskType mask = 1 << (kMaskSize - 1 - count);
+                MaskType mask = (MaskType)1 << (kMaskSize - 1 - count);
                 c |= mask;
             }
             
@@ -126,57 +293,885 @@ bool CollisionData::initWithFile(const std::string& fileName)
     
     CC_SAFE_DELETE(img);
     
+    setLayout(layout);
     return true;
 }
 
-bool CollisionData::setCollisionInfo(int x, int y, bool coli)
+bool CollisionData::initWithMappedFile(const std::string& fileName)
 {
-    if(x < 0 || y < 0 || x >= _width || y >= _height){
+    FILE* file = fopen(fileName.c_str(), "rb");
+    if(!file){
+        CCLOG("Can't open collision file %s", fileName.c_str());
         return false;
     }
- 
-    ssize_t pos = x + y * _width;
-    ssize_t idx = floor((float)pos/kMaskSize);
-    int shift = kMaskSize - 1 - pos%kMaskSize;
     
-    MaskType v_Old = _map[idx];
-    MaskType mask = (1 << shift);
-    MaskType t = mask & v_Old;
-    if(t == 0 && coli){
-        //already coli before
+    MapFileHeader header;
+    bool valid = fread(&header, sizeof(header), 1, file) == 1
+        && memcmp(header.magic, kMapFileMagic, sizeof(kMapFileMagic)) == 0
+        && header.formatVersion == kMapFileVersion
+        && header.maskBits == (uint32_t)kMaskSize
+        && header.wordCount == (uint64_t)header.width * header.height / kMaskSize + 2;
+    
+    size_t fileSize = 0;
+    if(valid){
+        fseek(file, 0, SEEK_END);
+        fileSize = (size_t)ftell(file);
+        valid = fileSize >= sizeof(header) + header.wordCount * sizeof(MaskType);
+    }
+    if(!valid){
+        CCLOG("Invalid collision file %s", fileName.c_str());
+        fclose(file);
         return false;
-    }else if(t != 0 && !coli){
-        //already not coli before
+    }
+    
+    _width = header.width;
+    _height = header.height;
+    
+    // the file is row major, converted after if needed
+    Layout layout = _layout;
+    _layout = LAYOUT_ROW_MAJOR;
+    resetMap();
+    _wordCount = (ssize_t)header.wordCount;
+    
+#if !defined(_WIN32)
+    // private and writable: shared with the page cache until setCollisionInfo touch a page
+    void* data = mmap(nullptr, fileSize, PROT_READ | PROT_WRITE, MAP_PRIVATE, fileno(file), 0);
+    if(data != MAP_FAILED){
+        _mappedData = data;
+        _mappedSize = fileSize;
+        _map = (MaskType*)((char*)data + sizeof(header));
+    }
+#endif
+    if(_map == nullptr){
+        _map = new MaskType[_wordCount]();
+        fseek(file, sizeof(header), SEEK_SET);
+        valid = fread(_map, sizeof(MaskType), _wordCount, file) == (size_t)_wordCount;
+    }
+    fclose(file);
+    
+    if(!valid){
+        releaseMap();
+        _width = 0;
+        _height = 0;
+        _wordCount = 0;
         return false;
-    }else{
+    }
+    
+    setLayout(layout);
+    return true;
+}
+
+bool CollisionData::saveToFile(const std::string& fileName) const
+{
+    FILE* file = fopen(fileName.c_str(), "wb");
+    if(!file){
+        return false;
+    }
+    
+    MapFileHeader header;
+    memcpy(header.magic, kMapFileMagic, sizeof(kMapFileMagic));
+    header.formatVersion = kMapFileVersion;
+    header.maskBits = kMaskSize;
+    header.width = _width;
+    header.height = _height;
+    header.reserved = 0;
+    header.wordCount = (uint64_t)_width * _height / kMaskSize + 2;
+    
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1;
+    if(_layout == LAYOUT_ROW_MAJOR){
+        written = written && fwrite(_map, sizeof(MaskType), header.wordCount, file) == header.wordCount;
+    }
+    else{
+        ssize_t tileCount = (ssize_t)_width * _height;
+        for (uint64_t idx = 0; idx < header.wordCount && written; idx ++) {
+            MaskType word = 0;
+            if((ssize_t)idx * kMaskSize < tileCount){
+                word = readBits(idx * kMaskSize);
+                // the tiles after the last one are 0 like in the row major map
+                ssize_t left = tileCount - (ssize_t)idx * kMaskSize;
+                if(left < kMaskSize){
+                    word &= ~(MaskType)0 << (kMaskSize - left);
+                }
+            }
+            written = fwrite(&word, sizeof(word), 1, file) == 1;
+        }
+    }
+    return fclose(file) == 0 && written;
+}
+
+bool CollisionData::isMappedFile(const std::string& fileName)
+{
+    return fileName.size() >= kMapFileExtension.size()
+        && fileName.compare(fileName.size() - kMapFileExtension.size(), kMapFileExtension.size(), kMapFileExtension) == 0;
+}
+
+bool CollisionData::setCollisionInfo(int x, int y, bool coli)
+{
+    if(x < 0 || y < 0 || x >= _width || y >= _height){
+        return false;
+    }
+    
+    if(_layout == LAYOUT_MORTON){
+        uint64_t& block = _blocks[getBlockIndex(x >> 3, y >> 3)];
+        uint64_t mask = (uint64_t)1 << getBlockBit(x, y);
+        if(((block & mask) == 0) == coli){
+            //already the same
+            return false;
+        }
+        block ^= mask;
+    }
+    else if(_layout == LAYOUT_CHUNKED){
+        // already the same, or not loaded
+        if(!_chunks->setCollision(x, y, coli)){
+            return false;
+        }
+    }
+    else{
+        ssize_t pos = x + y * _width;
+        ssize_t idx = pos / kMaskSize;
+        int shift = kMaskSize - 1 - pos%kMaskSize;
+        
+        MaskType v_Old = _map[idx];
+        MaskType mask = ((MaskType)1 << shift);
+        MaskType t = mask & v_Old;
+        if(t == 0 && coli){
+            //already coli before
+            return false;
+        }else if(t != 0 && !coli){
+            //already not coli before
+            return false;
+        }
+        
         //must XOR that value
         MaskType v_New = v_Old ^ mask;
         _map[idx] = v_New;
-        return true;
     }
+    
+    _version ++;
+    if(_occupancy){
+        _occupancy->update(x, y, coli);
+    }
+    if(_clearance){
+        _clearance->update(this, x, y);
+    }
+    for (auto listener : _listeners) {
+        listener->onCollisionChanged(this, x, y, coli);
+    }
+    return true;
 }
 
-bool CollisionData::haveCollisionAt(ssize_t pos)
+EditInfo CollisionData::fillRect(int x, int y, int w, int h, bool coli)
 {
-    ssize_t idx = floor((float)pos/kMaskSize);
+    // all the pixels are solid without mask
+    return editRect(nullptr, x, y, w, h, coli ? STAMP_OR : STAMP_CLEAR);
+}
+
+EditInfo CollisionData::stamp(const CollisionMask& mask, int x, int y, StampOp op)
+{
+    return editRect(&mask, x, y, mask.getWidth(), mask.getHeight(), op);
+}
+
+EditInfo CollisionData::editRect(const CollisionMask* mask, int x, int y, int w, int h, StampOp op)
+{
+    EditInfo info;
+    info.count = 0;
+    info.minX = info.minY = INT_MAX;
+    info.maxX = info.maxY = INT_MIN;
+    
+    int x0 = std::max(0, x);
+    int y0 = std::max(0, y);
+    int x1 = std::min((int)_width, x + w);
+    int y1 = std::min((int)_height, y + h);
+    if(x0 >= x1 || y0 >= y1){
+        return info;
+    }
+    
+    // the changed tiles are only needed one by one for the occupancy index and the listeners
+    std::vector<ChangedBits> changes;
+    bool keepChanges = _occupancy || !_listeners.empty();
+    
+    for (int row = y0; row < y1; row ++) {
+        int col = x0;
+        while (col < x1) {
+            // one storage word: its first tile, its size, and its tiles with the first in the highest bit
+            int start = 0;
+            int size = 0;
+            uint64_t free = 0;
+            ssize_t idx = 0;
+            if(_layout == LAYOUT_MORTON){
+                start = col & ~7;
+                size = 8;
+                idx = getBlockIndex(col >> 3, row >> 3);
+                free = ((_blocks[idx] >> ((row & 7) * 8)) & 0xFF) << 56;
+            }
+            else if(_layout == LAYOUT_CHUNKED){
+                start = col & ~(CollisionChunks::kChunkSize - 1);
+                size = CollisionChunks::kChunkSize;
+                free = _chunks->getRows(col >> CollisionChunks::kChunkShift, row >> CollisionChunks::kChunkShift)[row & (CollisionChunks::kChunkSize - 1)];
+            }
+            else{
+                // the word can start on the previous row
+                ssize_t rowPos = (ssize_t)row * _width;
+                idx = (rowPos + col) / kMaskSize;
+                start = (int)(idx * kMaskSize - rowPos);
+                size = kMaskSize;
+                free = (uint64_t)_map[idx] << (64 - kMaskSize);
+            }
+            
+            int first = col - start;
+            int last = std::min(x1, start + size) - start;
+            uint64_t range = (~(uint64_t)0 >> first) & (last >= 64 ? ~(uint64_t)0 : ~(~(uint64_t)0 >> last));
+            uint64_t changed = (free ^ applyStamp(free, readSolidBits(mask, row - y, start - x), range, op)) & range;
+            col = start + size;
+            
+            if(changed == 0){
+                continue;
+            }
+            if(_layout == LAYOUT_MORTON){
+                _blocks[idx] ^= (changed >> 56) << ((row & 7) * 8);
+            }
+            else if(_layout == LAYOUT_CHUNKED){
+                // nothing is written in an unloaded chunk
+                changed = _chunks->writeRow(start >> CollisionChunks::kChunkShift, row, free ^ changed, changed);
+                if(changed == 0){
+                    continue;
+                }
+            }
+            else{
+                _map[idx] ^= (MaskType)(changed >> (64 - kMaskSize));
+            }
+            
+            info.count += countBits64(changed);
+            info.minX = std::min(info.minX, start + countLeadingZeros64(changed));
+            info.maxX = std::max(info.maxX, start + 63 - countTrailingZeros64(changed));
+            info.minY = std::min(info.minY, row);
+            info.maxY = row;
+            if(keepChanges){
+                ChangedBits bits = {start, row, changed};
+                changes.push_back(bits);
+            }
+        }
+    }
+    
+    if(info.count == 0){
+        return info;
+    }
+    
+    _version ++;
+    applyEdit(info, changes);
+    return info;
+}
+
+void CollisionData::applyEdit(const EditInfo& info, const std::vector<ChangedBits>& changes)
+{
+    if(_occupancy){
+        for (auto& c : changes) {
+            for (uint64_t bits = c.bits; bits; bits &= bits - 1) {
+                int tx = c.x + 63 - countTrailingZeros64(bits);
+                _occupancy->update(tx, c.y, haveCollisionAtCoord(tx, c.y));
+            }
+        }
+    }
+    if(_clearance){
+        _clearance->updateRect(this, info.minX, info.minY, info.maxX - info.minX + 1, info.maxY - info.minY + 1);
+    }
+    for (auto listener : _listeners) {
+        if(listener->onCollisionRectChanged(this, info)){
+            continue;
+        }
+        for (auto& c : changes) {
+            for (uint64_t bits = c.bits; bits; bits &= bits - 1) {
+                int tx = c.x + 63 - countTrailingZeros64(bits);
+                listener->onCollisionChanged(this, tx, c.y, haveCollisionAtCoord(tx, c.y));
+            }
+        }
+    }
+}
+
+bool CollisionData::haveCollisionAt(ssize_t pos) const
+{
+    if(_layout != LAYOUT_ROW_MAJOR){
+        return haveCollisionAtCoord(pos % _width, pos / _width);
+    }
+    
+    ssize_t idx = pos / kMaskSize;
     MaskType v = _map[idx];
     int shift = kMaskSize - 1 - pos%kMaskSize;
-    MaskType mask = (1 << shift);
+    MaskType mask = ((MaskType)1 << shift);
     MaskType t = mask & v;
     return t == 0;
 }
 
-bool CollisionData::haveCollisionAtCoord(int x, int y)
+MaskType CollisionData::readBits(ssize_t pos) const
+{
+    if(_layout == LAYOUT_MORTON){
+        return readBitsMorton(pos % _width, pos / _width);
+    }
+    if(_layout == LAYOUT_CHUNKED){
+        return readBitsChunked(pos % _width, pos / _width);
+    }
+    
+    ssize_t idx = pos / kMaskSize;
+    int shift = pos % kMaskSize;
+    
+    MaskType v = _map[idx] << shift;
+    if(shift != 0){
+        v |= _map[idx + 1] >> (kMaskSize - shift);
+    }
+    return v;
+}
+
+bool CollisionData::haveCollisionAtCoord(int x, int y) const
 {
     if(x < 0 || y < 0 || x >= _width || y >= _height){
         return false;
     }
     
+    if(_layout == LAYOUT_MORTON){
+        return ((_blocks[getBlockIndex(x >> 3, y >> 3)] >> getBlockBit(x, y)) & 1) == 0;
+    }
+    if(_layout == LAYOUT_CHUNKED){
+        return _chunks->haveCollision(x, y);
+    }
+    
     ssize_t pos = x + y * _width;
     bool coli =  haveCollisionAt(pos);
     return coli;
 }
 
+MaskType CollisionData::readBitsMorton(int x, int y) const
+{
+    // a block row is one byte, highest bit first like the row major map
+    MaskType v = 0;
+    int filled = 0;
+    while (filled < kMaskSize && y < (int)_height) {
+        int n = std::min(kMaskSize - filled, (int)_width - x);
+        
+        // kMaskBits tiles + the offset in the first block fit in 5 bytes
+        uint64_t bytes = 0;
+        int bx = x >> 3;
+        int lastBx = std::min(bx + 4, _blocksX - 1);
+        for (int k = 0; bx + k <= lastBx; k ++) {
+            uint64_t row = (_blocks[getBlockIndex(bx + k, y >> 3)] >> ((y & 7) * 8)) & 0xFF;
+            bytes |= row << (56 - 8 * k);
+        }
+        MaskType bits = (MaskType)((bytes << (x & 7)) >> (64 - kMaskSize));
+        bits &= ~(MaskType)0 << (kMaskSize - n);
+        
+        v |= bits >> filled;
+        filled += n;
+        x = 0;
+        y ++;
+    }
+    return v;
+}
+
+MaskType CollisionData::readBitsChunked(int x, int y) const
+{
+    MaskType v = 0;
+    int filled = 0;
+    while (filled < kMaskSize && y < (int)_height) {
+        int n = std::min(kMaskSize - filled, (int)_width - x);
+        MaskType bits = (MaskType)(_chunks->readRow(x, y) >> (64 - kMaskSize));
+        bits &= ~(MaskType)0 << (kMaskSize - n);
+        
+        v |= bits >> filled;
+        filled += n;
+        x = 0;
+        y ++;
+    }
+    return v;
+}
+
+CollisionData::ChunkState CollisionData::getChunkState(int x, int y) const
+{
+    if(x < 0 || y < 0 || x >= (int)_width || y >= (int)_height){
+        return CHUNK_BLOCKED;
+    }
+    if(_layout != LAYOUT_CHUNKED){
+        return CHUNK_DENSE;
+    }
+    return _chunks->getState(x >> CollisionChunks::kChunkShift, y >> CollisionChunks::kChunkShift);
+}
+
+void CollisionData::chunkChanged(int cx, int cy, const uint64_t* rows)
+{
+    EditInfo info;
+    info.count = 0;
+    info.minX = info.minY = INT_MAX;
+    info.maxX = info.maxY = INT_MIN;
+    
+    // the tiles which differ from the previous rows, a row of the chunk is one word
+    int x0 = cx * CollisionChunks::kChunkSize;
+    int y0 = cy * CollisionChunks::kChunkSize;
+    int columns = std::min((int)_width - x0, CollisionChunks::kChunkSize);
+    int y1 = std::min((int)_height, y0 + CollisionChunks::kChunkSize);
+    uint64_t range = columns >= 64 ? ~(uint64_t)0 : ~(~(uint64_t)0 >> columns);
+    const uint64_t* current = _chunks->getRows(cx, cy);
+    std::vector<ChangedBits> changes;
+    for (int y = y0; y < y1; y ++) {
+        uint64_t changed = (current[y - y0] ^ rows[y - y0]) & range;
+        if(changed == 0){
+            continue;
+        }
+        info.count += countBits64(changed);
+        info.minX = std::min(info.minX, x0 + countLeadingZeros64(changed));
+        info.maxX = std::max(info.maxX, x0 + 63 - countTrailingZeros64(changed));
+        info.minY = std::min(info.minY, y);
+        info.maxY = y;
+        ChangedBits bits = {x0, y, changed};
+        changes.push_back(bits);
+    }
+    
+    if(info.count == 0){
+        return;
+    }
+    _version ++;
+    applyEdit(info, changes);
+}
+
+void CollisionData::loadChunks(int x, int y, int w, int h)
+{
+    CCASSERT(_layout == LAYOUT_CHUNKED && _chunkProvider, "Streaming need LAYOUT_CHUNKED and a provider");
+    
+    int x0 = std::max(0, x) >> CollisionChunks::kChunkShift;
+    int y0 = std::max(0, y) >> CollisionChunks::kChunkShift;
+    int x1 = (std::min((int)_width, x + w) - 1) >> CollisionChunks::kChunkShift;
+    int y1 = (std::min((int)_height, y + h) - 1) >> CollisionChunks::kChunkShift;
+    
+    uint64_t rows[CollisionChunks::kChunkSize];
+    for (int cy = y0; cy <= y1; cy ++) {
+        for (int cx = x0; cx <= x1; cx ++) {
+            if(_chunks->getState(cx, cy) != CHUNK_UNLOADED){
+                continue;
+            }
+            std::fill(rows, rows + CollisionChunks::kChunkSize, 0);
+            if(_chunkProvider->loadChunk(cx, cy, rows)){
+                const uint64_t* previous = _chunks->getRows(cx, cy);
+                _chunks->setRows(cx, cy, rows);
+                chunkChanged(cx, cy, previous);
+            }
+        }
+    }
+}
+
+void CollisionData::unloadChunks(int x, int y, int w, int h)
+{
+    CCASSERT(_layout == LAYOUT_CHUNKED && _chunkProvider, "Streaming need LAYOUT_CHUNKED and a provider");
+    
+    int x0 = std::max(0, x) >> CollisionChunks::kChunkShift;
+    int y0 = std::max(0, y) >> CollisionChunks::kChunkShift;
+    int x1 = (std::min((int)_width, x + w) - 1) >> CollisionChunks::kChunkShift;
+    int y1 = (std::min((int)_height, y + h) - 1) >> CollisionChunks::kChunkShift;
+    
+    uint64_t rows[CollisionChunks::kChunkSize];
+    for (int cy = y0; cy <= y1; cy ++) {
+        for (int cx = x0; cx <= x1; cx ++) {
+            if(_chunks->getState(cx, cy) == CHUNK_UNLOADED){
+                continue;
+            }
+            // copied, the dense rows are deleted by unload
+            const uint64_t* current = _chunks->getRows(cx, cy);
+            std::copy(current, current + CollisionChunks::kChunkSize, rows);
+            _chunkProvider->unloadChunk(cx, cy, rows, _chunks->isModified(cx, cy));
+            _chunks->unload(cx, cy);
+            chunkChanged(cx, cy, rows);
+        }
+    }
+}
+
+uint64_t CollisionData::getBlock(int bx, int by) const
+{
+    if(bx < 0 || by < 0 || bx >= _blocksX || by >= _blocksY){
+        return 0;
+    }
+    if(_layout == LAYOUT_MORTON){
+        return _blocks[getBlockIndex(bx, by)];
+    }
+    
+    uint64_t block = 0;
+    int x = bx * 8;
+    int n = std::min(8, (int)_width - x);
+    for (int row = 0; row < 8 && by * 8 + row < (int)_height; row ++) {
+        MaskType bits = readBits(x + (ssize_t)(by * 8 + row) * _width) >> (kMaskSize - 8);
+        bits &= (0xFF << (8 - n)) & 0xFF;
+        block |= (uint64_t)bits << (row * 8);
+    }
+    return block;
+}
+
+unsigned int CollisionData::getNeighbourMask(int x, int y) const
+{
+    if(_layout == LAYOUT_MORTON && x >= 0 && y >= 0 && x < (int)_width && y < (int)_height){
+        // (the tiles outside of the map are already 0 in the blocks)
+        int bx = x >> 3;
+        int by = y >> 3;
+        int shift = 6 - (x & 7);
+        unsigned int mask = 0;
+        
+        if((unsigned)((x & 7) - 1) < 6 && (unsigned)((y & 7) - 1) < 6){
+            // inside of a block: 3 bits of 3 rows of the same block
+            uint64_t block = _blocks[getBlockIndex(bx, by)];
+            for (int dy = -1; dy <= 1; dy ++) {
+                unsigned int row = (unsigned int)(block >> (((y & 7) + dy) * 8)) >> shift;
+                mask |= (row & 7) << ((dy + 1) * 3);
+            }
+            return mask;
+        }
+        
+        // on a block border: a 24 tiles window of the 3 blocks of each row
+        for (int dy = -1; dy <= 1; dy ++) {
+            int row = y + dy;
+            if(row < 0 || row >= (int)_height){
+                continue;
+            }
+            int rowShift = (row & 7) * 8;
+            uint32_t window = (uint32_t)((_blocks[getBlockIndex(bx, row >> 3)] >> rowShift) & 0xFF) << 8;
+            if(bx > 0){
+                window |= (uint32_t)((_blocks[getBlockIndex(bx - 1, row >> 3)] >> rowShift) & 0xFF) << 16;
+            }
+            if(bx + 1 < _blocksX){
+                window |= (uint32_t)((_blocks[getBlockIndex(bx + 1, row >> 3)] >> rowShift) & 0xFF);
+            }
+            mask |= ((window >> (shift + 8)) & 7) << ((dy + 1) * 3);
+        }
+        return mask;
+    }
+    
+    if(_layout == LAYOUT_CHUNKED && x > 0 && y > 0 && x + 1 < (int)_width && y + 1 < (int)_height
+       && (unsigned)((x & (CollisionChunks::kChunkSize - 1)) - 1) < CollisionChunks::kChunkSize - 2
+       && (unsigned)((y & (CollisionChunks::kChunkSize - 1)) - 1) < CollisionChunks::kChunkSize - 2){
+        // inside of a chunk: nothing to read in a free one, 3 bits of 3 rows in a dense one
+        const uint64_t* rows = _chunks->getRows(x >> CollisionChunks::kChunkShift, y >> CollisionChunks::kChunkShift);
+        int row = y & (CollisionChunks::kChunkSize - 1);
+        int shift = CollisionChunks::kChunkSize - 2 - (x & (CollisionChunks::kChunkSize - 1));
+        return (unsigned int)(((rows[row - 1] >> shift) & 7) | (((rows[row] >> shift) & 7) << 3) | (((rows[row + 1] >> shift) & 7) << 6));
+    }
+    
+    unsigned int mask = 0;
+    if(x < 0 || x >= (int)_width){
+        // only the border column can be in the map
+        for (int dy = -1; dy <= 1; dy ++) {
+            for (int dx = -1; dx <= 1; dx ++) {
+                int nx = x + dx;
+                int ny = y + dy;
+                if(nx >= 0 && ny >= 0 && nx < (int)_width && ny < (int)_height && !haveCollisionAtCoord(nx, ny)){
+                    mask |= 1u << ((dy + 1) * 3 + 1 - dx);
+                }
+            }
+        }
+        return mask;
+    }
+    
+    for (int dy = -1; dy <= 1; dy ++) {
+        int row = y + dy;
+        if(row < 0 || row >= (int)_height){
+            continue;
+        }
+        ssize_t pos = x + (ssize_t)row * _width;
+        unsigned int bits = (x > 0) ? (readBits(pos - 1) >> (kMaskSize - 3)) : (readBits(pos) >> (kMaskSize - 2));
+        if(x == (int)_width - 1){
+            bits &= ~1u;
+        }
+        mask |= (bits & 7) << ((dy + 1) * 3);
+    }
+    return mask;
+}
+
+void CollisionData::setLayout(Layout layout)
+{
+    if(layout == _layout){
+        return;
+    }
+    CCASSERT(kMaskSize <= 32, "The Morton layout read at most 32 tiles at once");
+    
+    if(_map == nullptr && _blocks == nullptr && _chunks == nullptr){
+        // not init yet
+        _layout = layout;
+        return;
+    }
+    
+    // the new tiles are read from the current layout
+    MaskType* map = nullptr;
+    uint64_t* blocks = nullptr;
+    CollisionChunks* chunks = nullptr;
+    
+    if(layout == LAYOUT_MORTON){
+        // the interleaved part cover the shortest side, rounded to a power of 2
+        int bitsX = 0;
+        int bitsY = 0;
+        while ((1 << bitsX) < _blocksX) bitsX ++;
+        while ((1 << bitsY) < _blocksY) bitsY ++;
+        _mortonBits = std::min(bitsX, bitsY);
+        
+        size_t blockCount = (size_t)1 << (bitsX + bitsY);
+        blocks = new uint64_t[blockCount]();
+        for (int by = 0; by < _blocksY; by ++) {
+            for (int bx = 0; bx < _blocksX; bx ++) {
+                blocks[getBlockIndex(bx, by)] = getBlock(bx, by);
+            }
+        }
+    }
+    else if(layout == LAYOUT_CHUNKED){
+        chunks = new CollisionChunks();
+        chunks->initWithSize(_width, _height, true);
+        
+        uint64_t rows[CollisionChunks::kChunkSize];
+        for (int cy = 0; cy < chunks->getChunksY(); cy ++) {
+            for (int cx = 0; cx < chunks->getChunksX(); cx ++) {
+                int x = cx * CollisionChunks::kChunkSize;
+                for (int r = 0; r < CollisionChunks::kChunkSize; r ++) {
+                    int y = cy * CollisionChunks::kChunkSize + r;
+                    rows[r] = 0;
+                    for (int k = 0; k < CollisionChunks::kChunkSize && x + k < (int)_width && y < (int)_height; k += kMaskSize) {
+                        rows[r] |= (uint64_t)readBits(x + k + (ssize_t)y * _width) << (64 - kMaskSize - k);
+                    }
+                }
+                chunks->setRows(cx, cy, rows);
+            }
+        }
+    }
+    else{
+        _wordCount = (ssize_t)_width * _height / kMaskSize + 2;
+        map = new MaskType[_wordCount]();
+        ssize_t tileCount = (ssize_t)_width * _height;
+        for (ssize_t idx = 0; idx * kMaskSize < tileCount; idx ++) {
+            map[idx] = readBits(idx * kMaskSize);
+        }
+    }
+    
+    if(_layout == LAYOUT_ROW_MAJOR){
+        releaseMap();
+        _wordCount = 0;
+    }else if(_layout == LAYOUT_MORTON){
+        CC_SAFE_DELETE_ARRAY(_blocks);
+    }else{
+        CC_SAFE_DELETE(_chunks);
+    }
+    if(map){
+        _map = map;
+    }
+    if(blocks){
+        _blocks = blocks;
+    }
+    if(chunks){
+        _chunks = chunks;
+    }
+    _layout = layout;
+}
+
+void CollisionData::haveCollisionAtCoords(const int* xs, const int* ys, size_t count, MaskType* result) const
+{
+    std::fill(result, result + (count + kMaskSize - 1) / kMaskSize, 0);
+    
+    if(_layout != LAYOUT_ROW_MAJOR){
+        for (size_t i = 0; i < count; i ++) {
+            if(haveCollisionAtCoord(xs[i], ys[i])){
+                result[i / kMaskSize] |= (MaskType)1 << (kMaskSize - 1 - i % kMaskSize);
+            }
+        }
+        return;
+    }
+    
+    // a big map miss the cache on every random query, visit it region by region instead
+    if(count >= kBatchBucketMinCount && (size_t)_wordCount * sizeof(MaskType) >= kBatchBucketMinMapBytes){
+        haveCollisionAtCoordsBucketed(xs, ys, count, result);
+        return;
+    }
+    
+    size_t i = 0;
+    
+#if defined(__AVX2__)
+    if(sizeof(MaskType) == 4 && (size_t)_width * _height < ((size_t)1 << 31)){
+        // 8 queries per step: gather the 8 elements and test the 8 bits at once
+        const __m256i width = _mm256_set1_epi32(_width);
+        const __m256i height = _mm256_set1_epi32(_height);
+        const __m256i lowBits = _mm256_set1_epi32(31);
+        const __m256i one = _mm256_set1_epi32(1);
+        const __m256i minusOne = _mm256_set1_epi32(-1);
+        for (; i + 8 <= count; i += 8) {
+            __m256i x = _mm256_loadu_si256((const __m256i*)(xs + i));
+            __m256i y = _mm256_loadu_si256((const __m256i*)(ys + i));
+            __m256i inside = _mm256_and_si256(_mm256_and_si256(_mm256_cmpgt_epi32(x, minusOne), _mm256_cmpgt_epi32(y, minusOne)),
+                                              _mm256_and_si256(_mm256_cmpgt_epi32(width, x), _mm256_cmpgt_epi32(height, y)));
+            __m256i pos = _mm256_and_si256(_mm256_add_epi32(x, _mm256_mullo_epi32(y, width)), inside);
+            
+            __m256i idx = _mm256_srli_epi32(pos, 5);
+            __m256i shift = _mm256_sub_epi32(lowBits, _mm256_and_si256(pos, lowBits));
+            __m256i v = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), (const int*)_map, idx, inside, 4);
+            __m256i bit = _mm256_and_si256(_mm256_srlv_epi32(v, shift), one);
+            
+            // bit cleared inside of the map = collision
+            __m256i coli = _mm256_andnot_si256(_mm256_cmpeq_epi32(bit, one), inside);
+            unsigned int hits = _mm256_movemask_ps(_mm256_castsi256_ps(coli));
+            
+            // lane 0 go to the highest bit
+            hits = ((hits & 0x0F) << 4) | ((hits & 0xF0) >> 4);
+            hits = ((hits & 0x33) << 2) | ((hits & 0xCC) >> 2);
+            hits = ((hits & 0x55) << 1) | ((hits & 0xAA) >> 1);
+            result[i / kMaskSize] |= (MaskType)hits << (kMaskSize - 8 - i % kMaskSize);
+        }
+    }
+#endif
+    
+    for (; i < count; i ++) {
+        if(haveCollisionAtCoord(xs[i], ys[i])){
+            result[i / kMaskSize] |= (MaskType)1 << (kMaskSize - 1 - i % kMaskSize);
+        }
+    }
+}
+
+void CollisionData::haveCollisionAtCoordsBucketed(const int* xs, const int* ys, size_t count, MaskType* result) const
+{
+    // counting sort of the queries by map region, 2 passes, no comparison
+    size_t bucketCount = (size_t)_width * _height / kBatchBucketTiles + 1;
+    std::vector<uint32_t> starts(bucketCount + 1, 0);
+    std::vector<uint64_t> queries(count);
+    
+    for (size_t i = 0; i < count; i ++) {
+        int x = xs[i];
+        int y = ys[i];
+        if(x >= 0 && y >= 0 && x < (int)_width && y < (int)_height){
+            starts[((size_t)x + (size_t)y * _width) / kBatchBucketTiles + 1] ++;
+        }
+    }
+    for (size_t b = 0; b < bucketCount; b ++) {
+        starts[b + 1] += starts[b];
+    }
+    size_t n = starts[bucketCount];
+    for (size_t i = 0; i < count; i ++) {
+        int x = xs[i];
+        int y = ys[i];
+        if(x >= 0 && y >= 0 && x < (int)_width && y < (int)_height){
+            // (position << 32) | query index
+            uint64_t pos = (uint64_t)x + (uint64_t)y * _width;
+            queries[starts[pos / kBatchBucketTiles] ++] = (pos << 32) | i;
+        }
+    }
+    
+    for (size_t k = 0; k < n; k ++) {
+        uint32_t i = (uint32_t)queries[k];
+        if(haveCollisionAt(queries[k] >> 32)){
+            result[i / kMaskSize] |= (MaskType)1 << (kMaskSize - 1 - i % kMaskSize);
+        }
+    }
+}
+
+void CollisionData::addListener(CollisionListener* listener)
+{
+    CCASSERT(listener, "Listener must be not null");
+    if(std::find(_listeners.begin(), _listeners.end(), listener) == _listeners.end()){
+        _listeners.push_back(listener);
+    }
+}
+
+void CollisionData::removeListener(CollisionListener* listener)
+{
+    _listeners.erase(std::remove(_listeners.begin(), _listeners.end(), listener), _listeners.end());
+}
+
+void CollisionData::enableOccupancyIndex()
+{
+    if(!_occupancy){
+        _occupancy = new OccupancyIndex();
+        _occupancy->initWithMap(this);
+    }
+}
+
+void CollisionData::disableOccupancyIndex()
+{
+    CC_SAFE_DELETE(_occupancy);
+}
+
+void CollisionData::enableClearanceMap(int maxClearance)
+{
+    if(!_clearance){
+        _clearance = new ClearanceMap();
+    }
+    _clearance->initWithMap(this, maxClearance);
+}
+
+void CollisionData::disableClearanceMap()
+{
+    CC_SAFE_DELETE(_clearance);
+}
+
+int CollisionData::countCollisionInRect(int x, int y, int w, int h) const
+{
+    if(_occupancy){
+        return _occupancy->countCollisionInRect(x, y, w, h);
+    }
+    
+    int x0 = std::max(0, x);
+    int y0 = std::max(0, y);
+    int x1 = std::min((int)_width, x + w);
+    int y1 = std::min((int)_height, y + h);
+    if(x0 >= x1 || y0 >= y1){
+        return 0;
+    }
+    if(_layout == LAYOUT_CHUNKED){
+        return _chunks->countCollisionInRect(x0, y0, x1 - x0, y1 - y0);
+    }
+    
+    // count the free bits of each row, kMaskBits tiles per read
+    int count = 0;
+    for (int row = y0; row < y1; row ++) {
+        ssize_t rowPos = (ssize_t)row * _width;
+        for (int col = x0; col < x1; col += kMaskSize) {
+            int n = std::min(kMaskSize, x1 - col);
+            MaskType valid = ~(MaskType)0 << (kMaskSize - n);
+            count += n - countBits64(readBits(rowPos + col) & valid);
+        }
+    }
+    return count;
+}
+
+bool CollisionData::isLineFree(int x0, int y0, int x1, int y1) const
+{
+    if(y0 == y1){
+        // a row is read kMaskBits tiles at once
+        return countCollisionInRect(std::min(x0, x1), y0, std::abs(x1 - x0) + 1, 1) == 0;
+    }
+    
+    int dx = std::abs(x1 - x0);
+    int dy = -std::abs(y1 - y0);
+    int sx = x0 < x1 ? 1 : -1;
+    int sy = y0 < y1 ? 1 : -1;
+    int err = dx + dy;
+    
+    while (true) {
+        if(haveCollisionAtCoord(x0, y0)){
+            return false;
+        }
+        if(x0 == x1 && y0 == y1){
+            return true;
+        }
+        int e2 = 2 * err;
+        if(e2 >= dy){
+            err += dy;
+            x0 += sx;
+        }
+        if(e2 <= dx){
+            err += dx;
+            y0 += sy;
+        }
+    }
+}
+
+uint32_t CollisionData::computeChecksum() const
+{
+    // FNV-1a over the collision bits
+    uint32_t hash = 2166136261u;
+    hash = (hash ^ _width) * 16777619u;
+    hash = (hash ^ _height) * 16777619u;
+    for (int y = 0; y < (int)_height; y ++) {
+        for (int x = 0; x < (int)_width; x ++) {
+            hash = (hash ^ (haveCollisionAtCoord(x, y) ? 1 : 0)) * 16777619u;
+        }
+    }
+    return hash;
+}
+
 #if defined(COCOS2D_DEBUG) && (COCOS2D_DEBUG > 0)
 void CollisionData::printMap()
 {
@@ -196,4 +1191,56 @@ void CollisionData::printMap()
     CCLOG("CollisionData END DUMP");
 }
 
+void CollisionData::benchmarkLayouts(int queries)
+{
+    if(_width < 3 || _height < 3){
+        return;
+    }
+    
+    // same random tiles and walk for both layouts
+    std::vector<int> xs(queries);
+    std::vector<int> ys(queries);
+    int x = _width / 2;
+    int y = _height / 2;
+    for (int i = 0; i < queries; i ++) {
+        // a walk with small steps, like the expansions of a search
+        x = std::max(1, std::min((int)_width - 2, x + rand() % 5 - 2));
+        y = std::max(1, std::min((int)_height - 2, y + rand() % 5 - 2));
+        xs[i] = (i & 1) ? x : rand() % _width;
+        ys[i] = (i & 1) ? y : rand() % _height;
+    }
+    
+    Layout original = _layout;
+    const char* names[] = {"row major", "morton", "chunked"};
+    Layout layouts[] = {LAYOUT_ROW_MAJOR, LAYOUT_MORTON, LAYOUT_CHUNKED};
+    for (int l = 0; l < 3; l ++) {
+        setLayout(layouts[l]);
+        unsigned int sum = 0;
+        
+        auto begin = std::chrono::steady_clock::now();
+        for (int i = 0; i < queries; i ++) {
+            sum += haveCollisionAtCoord(xs[i], ys[i]);
+        }
+        auto tiles = std::chrono::steady_clock::now();
+        for (int i = 1; i < queries; i += 2) {
+            for (int dy = -1; dy <= 1; dy ++) {
+                for (int dx = -1; dx <= 1; dx ++) {
+                    sum += haveCollisionAtCoord(xs[i] + dx, ys[i] + dy);
+                }
+            }
+        }
+        auto neighbours = std::chrono::steady_clock::now();
+        for (int i = 1; i < queries; i += 2) {
+            sum += getNeighbourMask(xs[i], ys[i]);
+        }
+        auto masks = std::chrono::steady_clock::now();
+        
+        CCLOG("%s: %d tiles %.2fms, %d x 9 neighbours %.2fms, %d neighbour masks %.2fms (%u)", names[l],
+              queries, std::chrono::duration<double, std::milli>(tiles - begin).count(),
+              queries / 2, std::chrono::duration<double, std::milli>(neighbours - tiles).count(),
+              queries / 2, std::chrono::duration<double, std::milli>(masks - neighbours).count(), sum);
+    }
+    setLayout(original);
+}
+
 #endif
\ No newline at end of file
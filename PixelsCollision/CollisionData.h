@@ -27,6 +27,10 @@
 
 #include "cocos2d.h"
 
+#if defined(__BMI2__)
+#include <immintrin.h>
+#endif
+
 /** 
  *   Define the mask type.
  *
@@ -37,30 +41,140 @@
 
 typedef uint32_t MaskType;
 
+class OccupancyIndex;
+class ClearanceMap;
+class CollisionChunks;
+class CollisionChunkProvider;
+class CollisionMask;
+class CollisionData;
+
+/**
+ *  Result of a bulk edit (CollisionData::fillRect, CollisionData::stamp), in map coordinates
+ */
+struct EditInfo
+{
+    int count;      // number of changed tiles
+    int minX;       // bounding box of the changed tiles, valid when count > 0
+    int minY;
+    int maxX;
+    int maxY;
+};
+
+/**
+ *  notified of the changes of a CollisionData, see CollisionData::addListener
+ */
+class CollisionListener
+{
+public:
+    virtual ~CollisionListener() {};
+    
+    /**
+     *  a tile changed, called after the version and the indexes are updated
+     */
+    virtual void onCollisionChanged(CollisionData* map, int x, int y, bool coli) = 0;
+    
+    /**
+     *  the tiles of a fillRect or a stamp changed at once, called after the version and the indexes are updated
+     *  @return false to get onCollisionChanged for each changed tile instead (default)
+     */
+    virtual bool onCollisionRectChanged(CollisionData* map, const EditInfo& info) { return false; };
+    
+    /**
+     *  the map is being deleted, the listener must forget it (no need to remove itself)
+     */
+    virtual void onCollisionDataDestroyed(CollisionData* map) {};
+};
+
 /** 
  *  CollisionData contain information of a map
  */
 class CollisionData
 {
 public:
+    /**
+     *  number of tiles in one MaskType element
+     */
+    static const int kMaskBits = sizeof(MaskType) * 8;
+    
+    /**
+     *  pixels with a lower alpha are walkable
+     */
+    static const unsigned char kAlphaThreshold = 10;
+    
+    /**
+     *  storage of the tiles, the queries give the same result with both
+     */
+    enum Layout {
+        /** kMaskBits tiles per element, row after row (default) */
+        LAYOUT_ROW_MAJOR,
+        /** 8x8 tiles per 64 bits block, blocks in Morton (Z) order: the neighbours of a tile are in 1 or 2 blocks */
+        LAYOUT_MORTON,
+        /** 64x64 tiles chunks, the uniform ones take no memory and the chunks can be streamed (see CollisionChunks) */
+        LAYOUT_CHUNKED
+    };
+    
+    /**
+     *  content of a 64x64 chunk of LAYOUT_CHUNKED
+     */
+    enum ChunkState {
+        /** every tile is free, a search can cross it without checking the tiles */
+        CHUNK_FREE,
+        CHUNK_BLOCKED,
+        /** free and blocked tiles */
+        CHUNK_DENSE,
+        /** not streamed in, every tile have collision */
+        CHUNK_UNLOADED
+    };
+    
+    /**
+     *  how stamp combine the solid pixels of a mask with the tiles under it
+     */
+    enum StampOp {
+        /** the tiles under the mask get its pixels: solid = collision, empty = free */
+        STAMP_SET,
+        /** the tiles under the solid pixels become free (destruction) */
+        STAMP_CLEAR,
+        /** the tiles under the solid pixels get collision (placement) */
+        STAMP_OR,
+        /** the tiles under the empty pixels become free, the collision is kept under the solid ones */
+        STAMP_AND
+    };
+    
     CollisionData() :
     _width(0),
     _height(0),
-    _map(nullptr)
+    _map(nullptr),
+    _wordCount(0),
+    _mappedData(nullptr),
+    _mappedSize(0),
+    _blocks(nullptr),
+    _blocksX(0),
+    _blocksY(0),
+    _mortonBits(0),
+    _chunks(nullptr),
+    _chunkProvider(nullptr),
+    _occupancy(nullptr),
+    _clearance(nullptr),
+    _layout(LAYOUT_ROW_MAJOR),
+    _version(0)
     {
     };
     
-    virtual ~CollisionData()
-    {
-        CC_SAFE_DELETE_ARRAY(_map);
-    }
+    virtual ~CollisionData();
     
     /**
      *  init with size, default will be have no collision
+     *  with LAYOUT_CHUNKED no tile memory is allocated
      *  @returns true if init successful
      */
     virtual bool initWithSize(int width, int height);
     
+    /**
+     *  init with LAYOUT_CHUNKED and every chunk unloaded, loadChunks get them from the provider (not owned)
+     *  @returns true if init successful
+     */
+    virtual bool initWithChunkProvider(int width, int height, CollisionChunkProvider* provider);
+    
     /** 
      *   init with read pixels from image
      *   @return true if init successful
@@ -68,30 +182,258 @@ public:
     virtual bool initWithFile(const std::string& fileName);
     
     /**
-     *  update the collision data
+     *  init from a file written by saveToFile, the tiles are memory mapped copy on write:
+     *  every process mapping the same file share the pages until it change a tile
+     *  LAYOUT_MORTON convert the tiles to private memory
+     *  @return true if init successful
+     */
+    virtual bool initWithMappedFile(const std::string& fileName);
+    
+    /**
+     *  write the tiles in the format of initWithMappedFile, row major whatever the layout
+     *  the file is only valid for the same MaskType and byte order
+     *  @return true if the file was written
+     */
+    bool saveToFile(const std::string& fileName) const;
+    
+    /**
+     *  @return true if the file name have the extension of the files of saveToFile (.cmap)
+     */
+    static bool isMappedFile(const std::string& fileName);
+    
+    /**
+     *  update the collision data, the tiles of the unloaded chunks can't be changed
      *  @return true if data changed
      */
     virtual bool setCollisionInfo(int x, int y, bool coli);
     
+    /**
+     *  set the collision of every tile of the rectangle, a whole storage word at a time
+     *  the indexes, the version and the listeners are updated once for the rectangle
+     *  @return the changed tiles, outside of the map and unloaded chunks are skipped
+     */
+    EditInfo fillRect(int x, int y, int w, int h, bool coli);
+    
+    /**
+     *  combine the mask placed with its bottom left pixel at (x, y) with the map, like fillRect
+     */
+    EditInfo stamp(const CollisionMask& mask, int x, int y, StampOp op);
+    
+    /**
+     *  convert the tiles to another layout, can be called before init
+     *  the version and the indexes built from the map don't change
+     */
+    void setLayout(Layout layout);
+    
     /**
      *  check the collision at coordinate
      *  return true if have collision
      */
-    bool haveCollisionAtCoord(int x, int y);
+    bool haveCollisionAtCoord(int x, int y) const;
+    
+    /**
+     *  state of the 64x64 chunk (x / 64, y / 64) of tile (x, y), outside of the map is CHUNK_BLOCKED
+     *  so a search skipping the free chunks never leave the map
+     *  only LAYOUT_CHUNKED know it, the other layouts return CHUNK_DENSE inside of the map
+     */
+    ChunkState getChunkState(int x, int y) const;
+    
+    inline bool isChunkFree(int x, int y) const {
+        return getChunkState(x, y) == CHUNK_FREE;
+    }
+    
+    /**
+     *  get the chunks of the rectangle which are not loaded from the provider, LAYOUT_CHUNKED only
+     *  like fillRect it change the version and notify the listeners once per chunk
+     */
+    void loadChunks(int x, int y, int w, int h);
+    
+    /**
+     *  give the loaded chunks of the rectangle back to the provider, their tiles have collision after
+     */
+    void unloadChunks(int x, int y, int w, int h);
+    
+    inline CollisionChunks* getChunks() const {
+        return _chunks;
+    }
+    
+    /**
+     *  the 8x8 tiles of block (bx, by) = tiles [bx * 8, bx * 8 + 8) * [by * 8, by * 8 + 8),
+     *  bit (y % 8) * 8 + 7 - x % 8 set = no collision, tiles outside of the map are 0
+     *  a single read with LAYOUT_MORTON
+     */
+    uint64_t getBlock(int bx, int by) const;
+    
+    /**
+     *  the 3x3 tiles around (x, y): bit (dy + 1) * 3 + 1 - dx set = no collision,
+     *  tiles outside of the map are 0 so it can be used as is by the engines
+     *  a single read for most tiles with LAYOUT_MORTON, 3 reads with LAYOUT_ROW_MAJOR
+     */
+    unsigned int getNeighbourMask(int x, int y) const;
+    
+    static inline bool isNeighbourFree(unsigned int mask, int dx, int dy) {
+        return (mask >> ((dy + 1) * 3 + 1 - dx)) & 1;
+    }
+    
+    /**
+     *  check the collision of many coordinates at once (xs[i], ys[i])
+     *  bit i of result is set if have collision, highest bit first like the map
+     *  result must have room for (count + kMaskBits - 1) / kMaskBits elements
+     */
+    void haveCollisionAtCoords(const int* xs, const int* ys, size_t count, MaskType* result) const;
+    
+    /**
+     *  the listeners are called by setCollisionInfo when a tile really change, and by the destructor
+     *  the map don't own them, remove them before deleting them
+     */
+    void addListener(CollisionListener* listener);
+    void removeListener(CollisionListener* listener);
+    
+    /**
+     *  build the optional occupancy index (4 bytes per tile), the rectangle queries
+     *  become O(log W * log H) and it is kept up to date by setCollisionInfo
+     *  init again the map will drop it
+     */
+    void enableOccupancyIndex();
+    void disableOccupancyIndex();
+    
+    inline OccupancyIndex* getOccupancyIndex() const {
+        return _occupancy;
+    }
+    
+    /**
+     *  build the optional clearance map (1 byte per tile) used by the engines for agents bigger than a tile
+     *  it is kept up to date by setCollisionInfo, init again the map will drop it
+     */
+    void enableClearanceMap(int maxClearance = 255);
+    void disableClearanceMap();
+    
+    inline ClearanceMap* getClearanceMap() const {
+        return _clearance;
+    }
+    
+    /**
+     *  number of collision tiles in the rectangle, outside of the map is free
+     *  O(log W * log H) with the occupancy index, O(h * w / kMaskBits) without
+     */
+    int countCollisionInRect(int x, int y, int w, int h) const;
+    
+    /**
+     *  @return true if no tile of the rectangle have collision
+     */
+    inline bool isRectFree(int x, int y, int w, int h) const {
+        return countCollisionInRect(x, y, w, h) == 0;
+    }
+    
+    /**
+     *  @return true if no tile of the line from (x0, y0) to (x1, y1) have collision, ends included
+     *  the tiles are the ones of the Bresenham line, outside of the map is free
+     */
+    bool isLineFree(int x0, int y0, int x1, int y1) const;
+    
+    /**
+     *  checksum of the collision bits, used to check that a precomputed file belong to this map
+     */
+    uint32_t computeChecksum() const;
+    
+    /**
+     *  read kMaskBits tiles starting at position pos (x + y * width),
+     *  first tile in the highest bit, bit set = no collision
+     */
+    MaskType readBits(ssize_t pos) const;
     
 #if defined(COCOS2D_DEBUG) && (COCOS2D_DEBUG > 0)
     /** debug dump map
      */
     void printMap();
+    
+    /** debug log the time of random queries with each layout
+     */
+    void benchmarkLayouts(int queries = 1000000);
 #endif
     
 protected:
     MaskType* _map;
+    ssize_t _wordCount;
+    void* _mappedData;
+    size_t _mappedSize;
+    uint64_t* _blocks;
+    int _blocksX;
+    int _blocksY;
+    int _mortonBits;
+    CollisionChunks* _chunks;
+    CollisionChunkProvider* _chunkProvider;
+    OccupancyIndex* _occupancy;
+    ClearanceMap* _clearance;
+    std::vector<CollisionListener *> _listeners;
     
-    bool haveCollisionAt(ssize_t pos);
+    // the bits changed by a bulk edit in one storage word, x is the tile of the highest bit
+    struct ChangedBits {
+        int x;
+        int y;
+        uint64_t bits;
+    };
+    
+    void allocateMap();
+    void releaseMap();
+    void resetMap();
+    
+    /**
+     *  the tiles of chunk (cx, cy) which differ from rows changed: update the version, the indexes
+     *  and notify the listeners like a fillRect of the chunk
+     */
+    void chunkChanged(int cx, int cy, const uint64_t* rows);
+    
+    /**
+     *  update the indexes and notify the listeners of the changes of a bulk edit, the version is already changed
+     */
+    void applyEdit(const EditInfo& info, const std::vector<ChangedBits>& changes);
+    
+    /**
+     *  apply op to the rectangle, the solid pixels come from mask placed at (x, y), or are all set without mask
+     */
+    EditInfo editRect(const CollisionMask* mask, int x, int y, int w, int h, StampOp op);
+    void haveCollisionAtCoordsBucketed(const int* xs, const int* ys, size_t count, MaskType* result) const;
+    
+    bool haveCollisionAt(ssize_t pos) const;
+    MaskType readBitsMorton(int x, int y) const;
+    MaskType readBitsChunked(int x, int y) const;
+    
+    /**
+     *  interleave the low bits of the block coordinates, the high bits of the longest side go on top
+     */
+    inline ssize_t getBlockIndex(int bx, int by) const {
+        uint64_t low = (uint64_t)1 << _mortonBits;
+#if defined(__BMI2__)
+        return (ssize_t)(_pdep_u64(bx & (low - 1), 0x5555555555555555ULL) | _pdep_u64(by & (low - 1), 0xAAAAAAAAAAAAAAAAULL) |
+                         ((uint64_t)((bx | by) >> _mortonBits) << (2 * _mortonBits)));
+#else
+        return (ssize_t)(spreadBits(bx & (low - 1)) | (spreadBits(by & (low - 1)) << 1) |
+                         ((uint64_t)((bx | by) >> _mortonBits) << (2 * _mortonBits)));
+#endif
+    }
+    
+    static inline uint64_t spreadBits(uint64_t v) {
+        v = (v | (v << 16)) & 0x0000FFFF0000FFFFULL;
+        v = (v | (v << 8)) & 0x00FF00FF00FF00FFULL;
+        v = (v | (v << 4)) & 0x0F0F0F0F0F0F0F0FULL;
+        v = (v | (v << 2)) & 0x3333333333333333ULL;
+        v = (v | (v << 1)) & 0x5555555555555555ULL;
+        return v;
+    }
+    
+    static inline int getBlockBit(int x, int y) {
+        return (y & 7) * 8 + 7 - (x & 7);
+    }
     
     CC_SYNTHESIZE_READONLY(unsigned int, _width, Width);
     CC_SYNTHESIZE_READONLY(unsigned int, _height, Height);
+    CC_SYNTHESIZE_READONLY(Layout, _layout, Layout);
+    
+    /**
+     *  increased every time the map change, caches built from the map compare it
+     */
+    CC_SYNTHESIZE_READONLY(unsigned int, _version, Version);
 };
 
 #endif /* defined(__Funny__CollisionData__) */
@@ -55,7 +55,9 @@ bool CollisionManager::init()
 bool CollisionManager::loadCollisionData(const std::string &file, const std::string &cachename)
 {
     auto m = new CollisionData();
-    if(m->initWithFile(file)){
+    // the .cmap files are memory mapped, shared by the processes loading the same file
+    bool loaded = CollisionData::isMappedFile(file) ? m->initWithMappedFile(file) : m->initWithFile(file);
+    if(loaded){
         _collisionArray.insert(std::make_pair(cachename, m));
         return true;
     }else{
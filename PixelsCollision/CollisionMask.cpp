@@ -0,0 +1,165 @@
+/****************************************************************************
+ Copyright (c) 2015 QuanNguyen
+ 
+ http://quannguyen.info
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+
+#include "CollisionMask.h"
+#include "BitUtils.h"
+
+USING_NS_CC;
+
+static const int kMaskSize = CollisionData::kMaskBits;
+
+static inline int countBits(MaskType v)
+{
+    return countBits64(v);
+}
+
+static inline int countLeadingZeros(MaskType v)
+{
+    return countLeadingZeros64(v) - (64 - kMaskSize);
+}
+
+static inline int countTrailingZeros(MaskType v)
+{
+    return countTrailingZeros64(v);
+}
+
+bool CollisionMask::initWithSize(int w, int h)
+{
+    _width = w;
+    _height = h;
+    _wordsPerRow = (w + kMaskSize - 1) / kMaskSize;
+    _rows.assign((size_t)_wordsPerRow * h, 0);
+    
+    return true;
+}
+
+bool CollisionMask::initWithFile(const std::string& fileName)
+{
+    Image* img = new Image();
+    if(!img->initWithImageFile(fileName)){
+        CC_SAFE_DELETE(img);
+        return false;
+    }
+    
+    initWithSize(img->getWidth(), img->getHeight());
+    unsigned char * data = img->getData();
+    
+    for (int y = 0; y < _height; y++)
+    {
+        // image rows are top to bottom
+        unsigned char *row = data + (size_t)(_height - 1 - y) * _width * 4;
+        for (int x = 0; x < _width; x++)
+        {
+            unsigned char a = *(row + x * 4 + 3);
+            if (a >= CollisionData::kAlphaThreshold)
+            {
+                setSolid(x, y, true);
+            }
+        }
+    }
+    
+    CC_SAFE_DELETE(img);
+    
+    return true;
+}
+
+void CollisionMask::setSolid(int x, int y, bool solid)
+{
+    if(x < 0 || y < 0 || x >= _width || y >= _height){
+        return;
+    }
+    
+    MaskType mask = (MaskType)1 << (kMaskSize - 1 - x % kMaskSize);
+    MaskType& v = _rows[(size_t)y * _wordsPerRow + x / kMaskSize];
+    v = solid ? (v | mask) : (v & ~mask);
+}
+
+bool CollisionMask::isSolid(int x, int y) const
+{
+    if(x < 0 || y < 0 || x >= _width || y >= _height){
+        return false;
+    }
+    
+    MaskType mask = (MaskType)1 << (kMaskSize - 1 - x % kMaskSize);
+    return (_rows[(size_t)y * _wordsPerRow + x / kMaskSize] & mask) != 0;
+}
+
+bool CollisionMask::overlaps(const CollisionData& map, int ox, int oy, OverlapInfo* info) const
+{
+    if(info){
+        info->count = 0;
+        info->minX = info->minY = INT_MAX;
+        info->maxX = info->maxY = INT_MIN;
+    }
+    
+    int mapWidth = map.getWidth();
+    int mapHeight = map.getHeight();
+    
+    // only the rows on the map can collide
+    int firstRow = std::max(0, -oy);
+    int lastRow = std::min(_height, mapHeight - oy);
+    
+    for (int y = firstRow; y < lastRow; y ++) {
+        const MaskType* row = getRow(y);
+        ssize_t rowPos = (ssize_t)(oy + y) * mapWidth;
+        
+        for (int k = 0; k < _wordsPerRow; k ++) {
+            MaskType m = row[k];
+            if(m == 0){
+                continue;
+            }
+            
+            // map x of the highest bit, clip the bits outside of the map
+            int sx = ox + k * kMaskSize;
+            if(sx < 0){
+                m = (sx <= -kMaskSize) ? 0 : (m & (~(MaskType)0 >> -sx));
+            }
+            int inside = mapWidth - sx;
+            if(inside < kMaskSize){
+                m = (inside <= 0) ? 0 : (m & (~(MaskType)0 << (kMaskSize - inside)));
+            }
+            if(m == 0){
+                continue;
+            }
+            
+            // the map bit is set when free, a solid pixel on a cleared bit is a hit
+            MaskType free = (sx >= 0) ? map.readBits(rowPos + sx) : (map.readBits(rowPos) >> -sx);
+            MaskType hit = m & ~free;
+            if(hit == 0){
+                continue;
+            }
+            
+            if(!info){
+                return true;
+            }
+            info->count += countBits(hit);
+            info->minX = std::min(info->minX, sx + countLeadingZeros(hit));
+            info->maxX = std::max(info->maxX, sx + kMaskSize - 1 - countTrailingZeros(hit));
+            info->minY = std::min(info->minY, oy + y);
+            info->maxY = std::max(info->maxY, oy + y);
+        }
+    }
+    
+    return info && info->count > 0;
+}
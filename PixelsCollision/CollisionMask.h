@@ -0,0 +1,101 @@
+/****************************************************************************
+ Copyright (c) 2015 QuanNguyen
+ 
+ http://quannguyen.info
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+
+#ifndef __Funny__CollisionMask__
+#define __Funny__CollisionMask__
+
+#include "CollisionData.h"
+
+/**
+ *  Result of an overlap test, in map coordinates
+ */
+struct OverlapInfo
+{
+    int count;      // number of overlapping pixels
+    int minX;
+    int minY;
+    int maxX;
+    int maxY;
+};
+
+/**
+ *  CollisionMask contain the solid pixels of a sprite
+ *
+ *  Rows are packed in MaskType elements (first pixel in the highest bit, like CollisionData)
+ *  and each row start at a new element so a row can be tested element by element.
+ *  Row 0 is the bottom row of the image, same as CollisionData.
+ */
+class CollisionMask
+{
+public:
+    CollisionMask() :
+    _width(0),
+    _height(0),
+    _wordsPerRow(0)
+    {
+    };
+    
+    virtual ~CollisionMask()
+    {
+    }
+    
+    /**
+     *  init with size, default will be have no solid pixel
+     *  @returns true if init successful
+     */
+    virtual bool initWithSize(int width, int height);
+    
+    /**
+     *  init with read pixels from image, same alpha threshold as CollisionData
+     *  @return true if init successful
+     */
+    virtual bool initWithFile(const std::string& fileName);
+    
+    void setSolid(int x, int y, bool solid);
+    bool isSolid(int x, int y) const;
+    
+    /**
+     *  test the mask placed with its bottom left pixel at (ox, oy) on the map
+     *  outside of the map is free, like CollisionData::haveCollisionAtCoord
+     *  @param info when not null, count all overlapping pixels and their bounding box
+     *  @return true if a solid pixel is on a collision
+     */
+    bool overlaps(const CollisionData& map, int ox, int oy, OverlapInfo* info = nullptr) const;
+    
+    /**
+     *  @return the elements of a row, getWordsPerRow() elements
+     */
+    inline const MaskType* getRow(int y) const {
+        return &_rows[(size_t)y * _wordsPerRow];
+    }
+    
+protected:
+    std::vector<MaskType> _rows;
+    
+    CC_SYNTHESIZE_READONLY(int, _width, Width);
+    CC_SYNTHESIZE_READONLY(int, _height, Height);
+    CC_SYNTHESIZE_READONLY(int, _wordsPerRow, WordsPerRow);
+};
+
+#endif /* defined(__Funny__CollisionMask__) */
@@ -0,0 +1,203 @@
+/****************************************************************************
+ Copyright (c) 2015 QuanNguyen
+ 
+ http://quannguyen.info
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+
+#include "CollisionOverlay.h"
+
+USING_NS_CC;
+
+static const int kMaskSize = CollisionData::kMaskBits;
+
+bool CollisionOverlay::initWithSize(int width, int height)
+{
+    _width = width;
+    _height = height;
+    
+    // one more element so readBits can always read the next one
+    _bits.assign((size_t)width * height / kMaskSize + 2, 0);
+    return true;
+}
+
+void CollisionOverlay::clear()
+{
+    std::fill(_bits.begin(), _bits.end(), 0);
+}
+
+void CollisionOverlay::setTile(int x, int y, bool blocked)
+{
+    if(x < 0 || y < 0 || x >= _width || y >= _height){
+        return;
+    }
+    setBits(x + (ssize_t)y * _width, 1, blocked);
+}
+
+void CollisionOverlay::setTiles(const int* xs, const int* ys, size_t count, bool blocked)
+{
+    for (size_t i = 0; i < count; i ++) {
+        int x = xs[i];
+        int y = ys[i];
+        if(x < 0 || y < 0 || x >= _width || y >= _height){
+            continue;
+        }
+        ssize_t pos = x + (ssize_t)y * _width;
+        MaskType mask = (MaskType)1 << (kMaskSize - 1 - pos % kMaskSize);
+        if(blocked){
+            _bits[pos / kMaskSize] |= mask;
+        }
+        else{
+            _bits[pos / kMaskSize] &= ~mask;
+        }
+    }
+}
+
+void CollisionOverlay::setRect(int x, int y, int w, int h, bool blocked)
+{
+    int x0 = std::max(0, x);
+    int y0 = std::max(0, y);
+    int x1 = std::min(_width, x + w);
+    int y1 = std::min(_height, y + h);
+    if(x0 >= x1){
+        return;
+    }
+    
+    for (int row = y0; row < y1; row ++) {
+        setBits(x0 + (ssize_t)row * _width, x1 - x0, blocked);
+    }
+}
+
+void CollisionOverlay::setBits(ssize_t pos, ssize_t count, bool blocked)
+{
+    // partial first word, whole words, partial last word
+    while (count > 0) {
+        ssize_t idx = pos / kMaskSize;
+        int shift = pos % kMaskSize;
+        int n = (int)std::min<ssize_t>(kMaskSize - shift, count);
+        
+        MaskType mask = ~(MaskType)0 >> shift;
+        if(shift + n < kMaskSize){
+            mask &= ~(~(MaskType)0 >> (shift + n));
+        }
+        
+        if(blocked){
+            _bits[idx] |= mask;
+        }
+        else{
+            _bits[idx] &= ~mask;
+        }
+        
+        pos += n;
+        count -= n;
+    }
+}
+
+MaskType CollisionOverlay::readBits(ssize_t pos) const
+{
+    ssize_t idx = pos / kMaskSize;
+    int shift = pos % kMaskSize;
+    
+    MaskType v = _bits[idx] << shift;
+    if(shift != 0){
+        v |= _bits[idx + 1] >> (kMaskSize - shift);
+    }
+    return v;
+}
+
+bool CollisionOverlay::isBlocked(const std::vector<CollisionOverlay*>& overlays, int x, int y)
+{
+    if(overlays.empty()){
+        return false;
+    }
+    
+    const CollisionOverlay* first = overlays.front();
+    if(x < 0 || y < 0 || x >= first->_width || y >= first->_height){
+        return false;
+    }
+    
+    ssize_t pos = x + (ssize_t)y * first->_width;
+    ssize_t idx = pos / kMaskSize;
+    MaskType word = 0;
+    for (auto overlay : overlays) {
+        CCASSERT(overlay->_width == first->_width && overlay->_height == first->_height, "Overlays must have the same size");
+        word |= overlay->_bits[idx];
+    }
+    return (word >> (kMaskSize - 1 - pos % kMaskSize)) & 1;
+}
+
+bool CollisionOverlay::isRectBlocked(const std::vector<CollisionOverlay*>& overlays, int x, int y, int w, int h)
+{
+    if(overlays.empty()){
+        return false;
+    }
+    
+    const CollisionOverlay* first = overlays.front();
+    int x0 = std::max(0, x);
+    int y0 = std::max(0, y);
+    int x1 = std::min(first->_width, x + w);
+    int y1 = std::min(first->_height, y + h);
+    
+    for (int row = y0; row < y1; row ++) {
+        ssize_t rowPos = (ssize_t)row * first->_width;
+        for (int col = x0; col < x1; col += kMaskSize) {
+            int n = std::min(kMaskSize, x1 - col);
+            MaskType word = 0;
+            for (auto overlay : overlays) {
+                word |= overlay->readBits(rowPos + col);
+            }
+            if(word & (~(MaskType)0 << (kMaskSize - n))){
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+unsigned int CollisionOverlay::getNeighbourMask(const std::vector<CollisionOverlay*>& overlays, int x, int y)
+{
+    if(overlays.empty()){
+        return 0;
+    }
+    
+    const CollisionOverlay* first = overlays.front();
+    int x0 = std::max(0, x - 1);
+    int x1 = std::min(first->_width - 1, x + 1);
+    if(x0 > x1){
+        return 0;
+    }
+    // the n tiles read go to bits 1 + x - x0 down to shift of their row
+    int n = x1 - x0 + 1;
+    int shift = 2 + x - x0 - n;
+    
+    unsigned int mask = 0;
+    for (int dy = -1; dy <= 1; dy ++) {
+        int row = y + dy;
+        if(row < 0 || row >= first->_height){
+            continue;
+        }
+        MaskType word = 0;
+        for (auto overlay : overlays) {
+            word |= overlay->readBits(x0 + (ssize_t)row * first->_width);
+        }
+        mask |= (unsigned int)(word >> (kMaskSize - n)) << ((dy + 1) * 3 + shift);
+    }
+    return mask;
+}
@@ -0,0 +1,110 @@
+/****************************************************************************
+ Copyright (c) 2015 QuanNguyen
+ 
+ http://quannguyen.info
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+
+#ifndef __Funny__CollisionOverlay__
+#define __Funny__CollisionOverlay__
+
+#include "CollisionData.h"
+
+/**
+ *  Tiles blocked for a while (units, doors...) on top of a CollisionData, without touching
+ *  the map or the indexes built from it. Same layout as the map (x + y * width, highest bit
+ *  first) but a set bit means blocked, so several overlays are merged with a plain OR.
+ *
+ *  The engines take a list of overlays (one per team for example) checked after the map.
+ */
+class CollisionOverlay
+{
+public:
+    CollisionOverlay() :
+    _width(0),
+    _height(0)
+    {
+    };
+    
+    virtual ~CollisionOverlay()
+    {
+    }
+    
+    /**
+     *  init with the size of the map, nothing is blocked
+     */
+    bool initWithSize(int width, int height);
+    
+    /**
+     *  unblock every tile
+     */
+    void clear();
+    
+    void setTile(int x, int y, bool blocked);
+    
+    /**
+     *  set the tiles (xs[i], ys[i]), tiles outside of the overlay are ignored
+     */
+    void setTiles(const int* xs, const int* ys, size_t count, bool blocked);
+    
+    /**
+     *  set the rectangle [x, x + w) * [y, y + h) a word at a time
+     */
+    void setRect(int x, int y, int w, int h, bool blocked);
+    
+    inline bool isBlocked(int x, int y) const {
+        if(x < 0 || y < 0 || x >= _width || y >= _height){
+            return false;
+        }
+        ssize_t pos = x + (ssize_t)y * _width;
+        return (_bits[pos / CollisionData::kMaskBits] >> (CollisionData::kMaskBits - 1 - pos % CollisionData::kMaskBits)) & 1;
+    }
+    
+    /**
+     *  read kMaskBits tiles starting at position pos (x + y * width), bit set = blocked
+     */
+    MaskType readBits(ssize_t pos) const;
+    
+    /**
+     *  @return true if one of the overlays block the tile, the words are OR-ed before the bit test
+     */
+    static bool isBlocked(const std::vector<CollisionOverlay*>& overlays, int x, int y);
+    
+    /**
+     *  @return true if one of the overlays block a tile of the rectangle [x, x + w) * [y, y + h)
+     */
+    static bool isRectBlocked(const std::vector<CollisionOverlay*>& overlays, int x, int y, int w, int h);
+    
+    /**
+     *  the 3x3 tiles around (x, y) blocked by one of the overlays, same bits as CollisionData::getNeighbourMask
+     *  but set = blocked, so the free tiles are getNeighbourMask(x, y) & ~getNeighbourMask(overlays, x, y)
+     */
+    static unsigned int getNeighbourMask(const std::vector<CollisionOverlay*>& overlays, int x, int y);
+    
+protected:
+    std::vector<MaskType> _bits;
+    
+    void setBits(ssize_t pos, ssize_t count, bool blocked);
+    
+    CC_SYNTHESIZE_READONLY(int, _width, Width);
+    CC_SYNTHESIZE_READONLY(int, _height, Height);
+};
+
+#endif /* defined(__Funny__CollisionOverlay__) */
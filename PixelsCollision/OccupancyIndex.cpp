@@ -0,0 +1,124 @@
+/****************************************************************************
+ Copyright (c) 2015 QuanNguyen
+ 
+ http://quannguyen.info
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+
+#include "OccupancyIndex.h"
+
+USING_NS_CC;
+
+bool OccupancyIndex::initWithMap(const CollisionData* map)
+{
+    _width = map->getWidth();
+    _height = map->getHeight();
+    
+    size_t stride = _width + 1;
+    _tree.assign(stride * (_height + 1), 0);
+    
+    // pyramid up to one block covering the whole map
+    _levels.clear();
+    _levelWidths.clear();
+    for (int shift = kFirstBlockShift; ; shift ++) {
+        int w = ((_width - 1) >> shift) + 1;
+        int h = ((_height - 1) >> shift) + 1;
+        _levels.push_back(std::vector<int32_t>((size_t)w * h, 0));
+        _levelWidths.push_back(w);
+        if(w == 1 && h == 1){
+            break;
+        }
+    }
+    
+    for (int y = 0; y < _height; y ++) {
+        for (int x = 0; x < _width; x ++) {
+            if(map->haveCollisionAtCoord(x, y)){
+                _tree[(x + 1) + (y + 1) * stride] = 1;
+                for (int l = 0; l < (int)_levels.size(); l ++) {
+                    int shift = kFirstBlockShift + l;
+                    _levels[l][(x >> shift) + (size_t)(y >> shift) * _levelWidths[l]] ++;
+                }
+            }
+        }
+    }
+    
+    // linear Fenwick build: push each node to its parent, rows then columns
+    for (int y = 1; y <= _height; y ++) {
+        for (int x = 1; x <= _width; x ++) {
+            int parent = x + (x & -x);
+            if(parent <= _width){
+                _tree[parent + y * stride] += _tree[x + y * stride];
+            }
+        }
+    }
+    for (int y = 1; y <= _height; y ++) {
+        int parent = y + (y & -y);
+        if(parent <= _height){
+            for (int x = 1; x <= _width; x ++) {
+                _tree[x + parent * stride] += _tree[x + y * stride];
+            }
+        }
+    }
+    
+    return true;
+}
+
+void OccupancyIndex::update(int x, int y, bool coli)
+{
+    int delta = coli ? 1 : -1;
+    size_t stride = _width + 1;
+    
+    for (int j = y + 1; j <= _height; j += j & -j) {
+        for (int i = x + 1; i <= _width; i += i & -i) {
+            _tree[i + j * stride] += delta;
+        }
+    }
+    
+    for (int l = 0; l < (int)_levels.size(); l ++) {
+        int shift = kFirstBlockShift + l;
+        _levels[l][(x >> shift) + (size_t)(y >> shift) * _levelWidths[l]] += delta;
+    }
+}
+
+int OccupancyIndex::computePrefix(int x, int y) const
+{
+    // collision count in [0, x) * [0, y)
+    size_t stride = _width + 1;
+    int sum = 0;
+    for (int j = y; j > 0; j -= j & -j) {
+        for (int i = x; i > 0; i -= i & -i) {
+            sum += _tree[i + j * stride];
+        }
+    }
+    return sum;
+}
+
+int OccupancyIndex::countCollisionInRect(int x, int y, int w, int h) const
+{
+    int x0 = std::max(0, x);
+    int y0 = std::max(0, y);
+    int x1 = std::min(_width, x + w);
+    int y1 = std::min(_height, y + h);
+    if(x0 >= x1 || y0 >= y1){
+        return 0;
+    }
+    
+    return computePrefix(x1, y1) - computePrefix(x0, y1) - computePrefix(x1, y0) + computePrefix(x0, y0);
+}
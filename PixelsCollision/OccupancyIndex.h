@@ -0,0 +1,102 @@
+/****************************************************************************
+ Copyright (c) 2015 QuanNguyen
+ 
+ http://quannguyen.info
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+
+#ifndef __Funny__OccupancyIndex__
+#define __Funny__OccupancyIndex__
+
+#include "CollisionData.h"
+
+/**
+ *  Acceleration structure for region queries on a CollisionData
+ *
+ *  - a 2D Fenwick tree of collision counts: count in any rectangle in O(log W * log H),
+ *    update in O(log W * log H), 4 bytes per tile
+ *  - a pyramid of collision counts for aligned blocks (8x8, 16x16, ...): O(1) test
+ *    if a coarse block is fully open or fully blocked, searches can skip it
+ *
+ *  Built and kept up to date by CollisionData (enableOccupancyIndex / setCollisionInfo).
+ */
+class OccupancyIndex
+{
+public:
+    static const int kFirstBlockShift = 3;
+    
+    OccupancyIndex() :
+    _width(0),
+    _height(0)
+    {
+    };
+    
+    virtual ~OccupancyIndex()
+    {
+    }
+    
+    bool initWithMap(const CollisionData* map);
+    
+    /**
+     *  a tile changed, coli is the new value
+     */
+    void update(int x, int y, bool coli);
+    
+    /**
+     *  number of collision tiles in the rectangle (clipped to the map)
+     */
+    int countCollisionInRect(int x, int y, int w, int h) const;
+    
+    /**
+     *  @return number of pyramid levels, level l is made of (8 << l) square blocks
+     */
+    inline int getLevelCount() const {
+        return (int)_levels.size();
+    }
+    
+    inline int getBlockSize(int level) const {
+        return 1 << (kFirstBlockShift + level);
+    }
+    
+    /**
+     *  collision count of the block of the level containing tile (x, y)
+     */
+    inline int getBlockCollisionCount(int level, int x, int y) const {
+        int shift = kFirstBlockShift + level;
+        return _levels[level][(x >> shift) + (size_t)(y >> shift) * _levelWidths[level]];
+    }
+    
+    inline bool isBlockFree(int level, int x, int y) const {
+        return getBlockCollisionCount(level, x, y) == 0;
+    }
+    
+protected:
+    // 1-based Fenwick tree of (width + 1) * (height + 1)
+    std::vector<int32_t> _tree;
+    std::vector<std::vector<int32_t> > _levels;
+    std::vector<int> _levelWidths;
+    
+    int computePrefix(int x, int y) const;
+    
+    CC_SYNTHESIZE_READONLY(int, _width, Width);
+    CC_SYNTHESIZE_READONLY(int, _height, Height);
+};
+
+#endif /* defined(__Funny__OccupancyIndex__) */
@@ -0,0 +1,80 @@
+/****************************************************************************
+ Copyright (c) 2015 QuanNguyen
+ 
+ http://quannguyen.info
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+
+#include "PathTraceReplayer.h"
+
+using namespace pathfinding::trace;
+
+/**
+ *  pathtrace [-e astar|dijkstra] [-d 0|1] [-t threads] <trace file> <map id>=<map file> ...
+ *  the maps are loaded like CollisionManager (.cmap memory mapped, images otherwise)
+ */
+int main(int argc, char** argv)
+{
+    ReplayOptions options;
+    int arg = 1;
+    for (; arg + 1 < argc && argv[arg][0] == '-'; arg += 2) {
+        if(strcmp(argv[arg], "-e") == 0){
+            options.engine = strcmp(argv[arg + 1], "dijkstra") == 0 ? TRACE_ENGINE_DIJKSTRA : TRACE_ENGINE_ASTAR;
+        }else if(strcmp(argv[arg], "-d") == 0){
+            options.bidirectional = atoi(argv[arg + 1]);
+        }else if(strcmp(argv[arg], "-t") == 0){
+            options.threadCount = atoi(argv[arg + 1]);
+        }
+    }
+    if(arg >= argc){
+        fprintf(stderr, "usage: %s [-e astar|dijkstra] [-d 0|1] [-t threads] <trace file> <map id>=<map file> ...\n", argv[0]);
+        return 1;
+    }
+    
+    TraceReplayer replayer;
+    if(!replayer.initWithFile(argv[arg])){
+        fprintf(stderr, "Can't read trace %s\n", argv[arg]);
+        return 1;
+    }
+    
+    std::vector<CollisionData *> maps;
+    for (arg ++; arg < argc; arg ++) {
+        std::string map = argv[arg];
+        size_t split = map.find('=');
+        std::string fileName = split == std::string::npos ? "" : map.substr(split + 1);
+        auto data = new CollisionData();
+        bool loaded = !fileName.empty() &&
+            (CollisionData::isMappedFile(fileName) ? data->initWithMappedFile(fileName) : data->initWithFile(fileName));
+        if(!loaded){
+            fprintf(stderr, "Can't load map %s\n", argv[arg]);
+            return 1;
+        }
+        replayer.addMap((uint32_t)atoi(map.substr(0, split).c_str()), data);
+        maps.push_back(data);
+    }
+    
+    ReplayReport report = replayer.replay(options);
+    printf("%s\n", report.getDescription().c_str());
+    
+    for (auto map : maps) {
+        delete map;
+    }
+    return report.differences == 0 ? 0 : 2;
+}